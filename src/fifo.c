@@ -1,5 +1,32 @@
 #include "utils.h"
 
+/*
+    When FIFO_STATS is 1, the time that every add and get takes is recorded in
+    a latency histogram, which needs unit_hist.h from the tests. A histogram is
+    not locked, so every thread has its own, which counts the calls that the
+    thread made to every FIFO. A thread merges its histograms into a total with
+    unit_hist_merge() before it ends.
+*/
+#if FIFO_STATS == 1
+#include <time.h>
+#include "unit_hist.h"
+
+__thread unit_hist_t fifo_add_ns;
+__thread unit_hist_t fifo_get_ns;
+
+static uint64_t fifo_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#define FIFO_STAT_START     uint64_t fifo_start = fifo_now()
+#define FIFO_STAT(h)        unit_hist_record(&(h), fifo_now() - fifo_start)
+#else
+#define FIFO_STAT_START
+#define FIFO_STAT(h)
+#endif
+
 typedef struct fifo_element {
     void *data;
     size_t size;
@@ -50,6 +77,7 @@ void fifo_destroy(fifo_t fifo) {
     Add an element to the FIFO.
 */
 void fifo_add(fifo_t fifo, void *data, size_t size) {
+    FIFO_STAT_START;
     MARK();
     fifo_struct_t *fs = (fifo_struct_t *)fifo;
     fifo_element_t *nelem;
@@ -76,10 +104,14 @@ void fifo_add(fifo_t fifo, void *data, size_t size) {
         else {
             fs->last->next = nelem;
             fs->last = nelem;
+            // every item was read, so the new one is the next to read
+            if(fs->crnt == NULL)
+                fs->crnt = nelem;
         }
     }
     else
         fatal_error("attempt to add to an invalid FIFO");
+    FIFO_STAT(fifo_add_ns);
 }
 
 /*
@@ -88,6 +120,7 @@ void fifo_add(fifo_t fifo, void *data, size_t size) {
     without copying the data.
 */
 int fifo_get(fifo_t fifo, void *data, size_t size) {
+    FIFO_STAT_START;
     MARK();
     fifo_struct_t *fs = (fifo_struct_t *)fifo;
 
@@ -99,10 +132,12 @@ int fifo_get(fifo_t fifo, void *data, size_t size) {
             // the position in the FIFO has been advanced, even if no data was
             // copied.
             fs->crnt = fs->crnt->next;
+            FIFO_STAT(fifo_get_ns);
             return 1;
         }
     }
 
+    FIFO_STAT(fifo_get_ns);
     return 0; // fail or at the end of the list
 }
 
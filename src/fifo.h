@@ -0,0 +1,24 @@
+/*
+ * Public interface of the FIFO. This is used by code that links with the FIFO
+ * object instead of including fifo.c.
+ */
+#ifndef _FIFO_H_
+#define _FIFO_H_
+
+#include "utils.h"
+
+fifo_t fifo_create(void);
+void fifo_destroy(fifo_t fifo);
+void fifo_add(fifo_t fifo, void *data, size_t size);
+int fifo_get(fifo_t fifo, void *data, size_t size);
+int fifo_reset(fifo_t fifo);
+
+#if FIFO_STATS == 1
+#include "unit_hist.h"
+
+// the nanoseconds that every fifo_add() and fifo_get() of the calling thread took
+extern __thread unit_hist_t fifo_add_ns;
+extern __thread unit_hist_t fifo_get_ns;
+#endif
+
+#endif /* _FIFO_H_ */
@@ -1,5 +1,17 @@
 /*
- * This file exists because fifo.c needs to include a file by this name. all
- * esential definitions are created in tests.
+ * This file exists because fifo.c needs to include a file by this name. It
+ * declares what fifo.c needs from the rest of the program so that it can be
+ * compiled on its own. The definitions are created in tests.
  */
+#ifndef _UTILS_H_
+#define _UTILS_H_
 
+#include <stdlib.h>
+#include <string.h>
+
+typedef void* fifo_t;
+
+void MARK(void);
+void fatal_error(const char *fmt, ...);
+
+#endif /* _UTILS_H_ */
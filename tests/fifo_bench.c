@@ -0,0 +1,206 @@
+/*
+ *  FIFO benchmark. This program measures the FIFO, as it is compiled into
+ *  fifo.o, for every payload size from 8 bytes to 1 MB and every queue depth
+ *  up to 10 million items, and prints a CSV row for every operation.
+ *
+ *  The operations are fifo_add() of every item, fifo_get() of every item,
+ *  fifo_reset() followed by fifo_get() of every item again (replay), and
+ *  fifo_destroy(). Every add and get is timed on its own into a latency
+ *  histogram, with the cost of reading the clock taken off, so that the tail
+ *  is seen as well as the mean. fifo_destroy() is timed as a whole and its
+ *  time is spread over the items.
+ *
+ *  The FIFO keeps every item in an allocation of its own, so it has one way
+ *  of storing them. What it does offer is to add an item without copying the
+ *  data into it and to get one without copying the data out, by passing NULL
+ *  for the data. The copy mode passes a buffer and the nocopy mode passes
+ *  NULL, which shows how much of the time goes to the allocator and how much
+ *  to the copies.
+ *
+ *  A depth that would take more than --max-bytes of memory for the payload
+ *  size is left out.
+ *
+ *  usage: fifo_bench [options]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include "fifo.h"
+#include "unit_hist.h"
+
+// the memory that an item takes besides its payload, for the element and
+// for the headers of the two allocations
+#define ITEM_OVERHEAD   64
+
+static const size_t sizes[] = { 8, 64, 512, 4096, 32768, 262144, 1048576 };
+static const size_t depths[] = { 1000, 10000, 100000, 1000000, 10000000 };
+
+typedef struct {
+    const char *name;
+    int copy;
+} bench_mode_t;
+
+static const bench_mode_t modes[] = { { "copy", 1 }, { "nocopy", 0 } };
+
+static uint64_t overhead = 0;
+static unit_hist_t hist;
+
+/*
+ *  fifo.c needs these from the rest of the program.
+ */
+void MARK(void) {
+}
+
+void fatal_error(const char *fmt, ...) {
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "fatal error: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(2);
+}
+
+static inline uint64_t bench_now(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ *  The least time between two reads of the clock, which every timed call
+ *  also takes.
+ */
+static void bench_calibrate(void) {
+
+    overhead = UINT64_MAX;
+    for(int i = 0; i < 10000; i++) {
+        uint64_t start = bench_now();
+        uint64_t ns = bench_now() - start;
+        if(ns < overhead)
+            overhead = ns;
+    }
+}
+
+static inline void bench_record(uint64_t start) {
+
+    uint64_t ns = bench_now() - start;
+    unit_hist_record(&hist, (ns > overhead) ? ns - overhead : 0);
+}
+
+static void bench_row(const char *op, const bench_mode_t *mode, size_t size, size_t depth) {
+
+    double ns = (double)hist.sum / (double)hist.count;
+
+    printf("%s,%s,%zu,%zu,%.1f,%.0f,%llu,%llu,%llu\n", op, mode->name, size, depth,
+           ns, (ns > 0) ? 1e9 / ns : 0.0,
+           (unsigned long long)unit_hist_percentile(&hist, 50.0),
+           (unsigned long long)unit_hist_percentile(&hist, 99.0),
+           (unsigned long long)unit_hist_percentile(&hist, 99.9));
+    fflush(stdout);
+}
+
+static void bench_run(const bench_mode_t *mode, size_t size, size_t depth, char *in, char *out) {
+
+    char *src = mode->copy ? in : NULL;
+    char *dst = mode->copy ? out : NULL;
+    fifo_t fifo = fifo_create();
+
+    unit_hist_init(&hist);
+    for(size_t i = 0; i < depth; i++) {
+        uint64_t start = bench_now();
+        fifo_add(fifo, src, size);
+        bench_record(start);
+    }
+    bench_row("add", mode, size, depth);
+
+    unit_hist_init(&hist);
+    for(size_t i = 0; i < depth; i++) {
+        uint64_t start = bench_now();
+        fifo_get(fifo, dst, size);
+        bench_record(start);
+    }
+    bench_row("get", mode, size, depth);
+
+    // the reset is counted in the first get
+    unit_hist_init(&hist);
+    for(size_t i = 0; i < depth; i++) {
+        uint64_t start = bench_now();
+        if(i == 0)
+            fifo_reset(fifo);
+        fifo_get(fifo, dst, size);
+        bench_record(start);
+    }
+    bench_row("replay", mode, size, depth);
+
+    uint64_t start = bench_now();
+    fifo_destroy(fifo);
+    uint64_t ns = bench_now() - start;
+    double per = (double)ns / (double)depth;
+    printf("destroy,%s,%zu,%zu,%.1f,%.0f,,,\n", mode->name, size, depth,
+           per, (per > 0) ? 1e9 / per : 0.0);
+    fflush(stdout);
+}
+
+static void bench_usage(const char *prog) {
+
+    printf("usage: %s [options]\n", prog);
+    printf("  --max-bytes=n   leave out the depths that take more than n bytes (1 GB)\n");
+    printf("  --max-depth=n   leave out the depths of more than n items\n");
+    printf("  --max-size=n    leave out the payloads of more than n bytes\n");
+    printf("  --help          print this message and exit\n");
+}
+
+int main(int argc, char **argv) {
+
+    size_t max_bytes = (size_t)1 << 30;
+    size_t max_depth = SIZE_MAX;
+    size_t max_size = SIZE_MAX;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strncmp(argv[i], "--max-bytes=", 12))
+            max_bytes = strtoull(&argv[i][12], NULL, 0);
+        else if(!strncmp(argv[i], "--max-depth=", 12))
+            max_depth = strtoull(&argv[i][12], NULL, 0);
+        else if(!strncmp(argv[i], "--max-size=", 11))
+            max_size = strtoull(&argv[i][11], NULL, 0);
+        else if(!strcmp(argv[i], "--help")) {
+            bench_usage(argv[0]);
+            return 0;
+        }
+        else {
+            printf("%s: unknown option \"%s\"\n", argv[0], argv[i]);
+            bench_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    char *in = malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    char *out = malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    if(in == NULL || out == NULL)
+        fatal_error("cannot allocate the payload buffers");
+    memset(in, 0x5a, sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+
+    bench_calibrate();
+    printf("op,mode,size,depth,ns_per_op,ops_per_s,p50_ns,p99_ns,p999_ns\n");
+
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for(size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+            if(sizes[s] > max_size || depths[d] > max_depth ||
+               depths[d] > max_bytes / (sizes[s] + ITEM_OVERHEAD))
+                continue;
+            for(size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+                bench_run(&modes[m], sizes[s], depths[d], in, out);
+        }
+    }
+
+    free(in);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ *  These tests count the file IO of the FIFO and its users. The calls go to the
+ *  real files, and the suite checks how many of them there were and how many
+ *  bytes they moved.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#define FILE_IO_USED 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  Write the items in the FIFO to a file, as many as fit in a block at a time,
+ *  so that a FIFO of small items does not take a system call for each one.
+ */
+static void fifo_save(fifo_t fifo, int fd, size_t size) {
+
+    char block[4096];
+    size_t used = 0;
+
+    while(fifo_get(fifo, &block[used], size)) {
+        used += size;
+        if(used + size > sizeof(block)) {
+            if(write(fd, block, used) != (ssize_t)used)
+                return;
+            used = 0;
+        }
+    }
+    if(used > 0)
+        write(fd, block, used);
+}
+
+DEF_TEST(fifo_save_batches_its_writes)
+    static int32_t items[3000], copy[3000];
+    char path[64];
+    fifo_t ptr = fifo_create();
+
+    for(int i = 0; i < 3000; i++) {
+        items[i] = i * 31;
+        fifo_add(ptr, &items[i], sizeof(int32_t));
+    }
+
+    snprintf(path, sizeof(path), "/tmp/fifo_save.%d", (int)getpid());
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert_int_not_equal(-1, fd);
+    fifo_save(ptr, fd, sizeof(int32_t));
+    close(fd);
+    fifo_destroy(ptr);
+
+    // 12000 bytes in blocks of 4096
+    assert_max_write_calls(3);
+    assert_bytes_written(sizeof(items));
+
+    FILE *fp = fopen(path, "rb");
+    assert_ptr_not_null(fp);
+    assert_int_equal(3000, (int)fread(copy, sizeof(int32_t), 3000, fp));
+    fclose(fp);
+    assert_int_equal(0, unlink(path));
+
+    assert_bytes_read(sizeof(items));
+    assert_array_equal_i32(items, copy, 3000);
+    assert_io_entered_count(open, 1);
+    assert_io_entered_count(fopen, 1);
+    assert_files_closed();
+END_TEST
+
+DEF_TEST_MAIN("FIFO file IO tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST(fifo_save_batches_its_writes);
+END_TEST_MAIN
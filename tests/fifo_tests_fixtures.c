@@ -0,0 +1,108 @@
+/*
+ *  These tests share one large set of items, which the suite setup makes once.
+ *  Every test gets a new FIFO from the setup of the tests, and the teardown
+ *  checks that the FIFO gave back all of its memory.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  The items are made once for the whole suite, and each test that uses them
+ *  gets a new FIFO of its own from the setup.
+ */
+#define NUM_ITEMS 100000
+
+DEF_SUITE_SETUP(make_items, int32_t)
+    fixture = malloc(NUM_ITEMS * sizeof(int32_t));
+    for(int i = 0; i < NUM_ITEMS; i++)
+        fixture[i] = i * 7919 - 4000000;
+END_SUITE_SETUP
+
+DEF_SUITE_TEARDOWN(free_items, int32_t)
+    free(fixture);
+END_SUITE_TEARDOWN
+
+static fifo_t items_fifo;
+
+DEF_SETUP(create_items_fifo)
+    items_fifo = fifo_create();
+    assert_memory_pool_size(32);
+END_SETUP
+
+DEF_TEARDOWN(destroy_items_fifo)
+    fifo_destroy(items_fifo);
+    assert_memory_pool_size(0);
+END_TEARDOWN
+
+DEF_TEST(fifo_returns_many_items_in_order)
+    const int32_t *items = FIXTURE(int32_t);
+    static int32_t copy[NUM_ITEMS];
+
+    for(int i = 0; i < NUM_ITEMS; i++)
+        fifo_add(items_fifo, (void*)&items[i], sizeof(int32_t));
+    assert_memory_pool_size(32 + NUM_ITEMS * (24 + sizeof(int32_t)));
+
+    for(int i = 0; i < NUM_ITEMS; i++)
+        if(1 != fifo_get(items_fifo, &copy[i], sizeof(int32_t)))
+            break;
+    assert_array_equal_i32(items, copy, NUM_ITEMS);
+    assert_int_equal(-4000000, copy[0]);
+    assert_int_equal(0, fifo_get(items_fifo, copy, sizeof(int32_t)));
+END_TEST
+
+/*
+ *  This test turns the items around where they are. It is a snapshot test, so
+ *  it is forked with its own copy of them and the tests after it still see
+ *  them in the order that the suite setup made them.
+ */
+DEF_TEST(fifo_returns_reversed_items_in_order)
+    int32_t *items = MUTABLE_FIXTURE(int32_t);
+    static int32_t copy[NUM_ITEMS];
+
+    for(int i = 0, j = NUM_ITEMS-1; i < j; i++, j--) {
+        int32_t tmp = items[i];
+        items[i] = items[j];
+        items[j] = tmp;
+    }
+
+    for(int i = 0; i < NUM_ITEMS; i++)
+        fifo_add(items_fifo, &items[i], sizeof(int32_t));
+    for(int i = 0; i < NUM_ITEMS; i++)
+        if(1 != fifo_get(items_fifo, &copy[i], sizeof(int32_t)))
+            break;
+    assert_array_equal_i32(items, copy, NUM_ITEMS);
+    assert_int_equal((NUM_ITEMS-1) * 7919 - 4000000, copy[0]);
+END_TEST
+
+DEF_TEST_MAIN("FIFO fixture tests")
+    TRACK_MOCK("fatal_error");
+    ADD_SUITE_SETUP(make_items);
+    ADD_SUITE_TEARDOWN(free_items);
+    ADD_SETUP(create_items_fifo);
+    ADD_TEARDOWN(destroy_items_fifo);
+    ADD_TEST(fifo_returns_reversed_items_in_order);
+    SET_SNAPSHOT(fifo_returns_reversed_items_in_order);
+    ADD_TEST(fifo_returns_many_items_in_order);
+END_TEST_MAIN
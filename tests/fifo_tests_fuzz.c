@@ -0,0 +1,89 @@
+/*
+ *  These tests run the FIFO through sequences of operations that are read from
+ *  the input of the fuzzer, and compare it against a list. "make fuzz" runs them
+ *  with new inputs, and the normal runs replay the corpus in tests/corpus.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  Any sequence of adds, gets and resets has to behave like a list with a
+ *  read position. The operations and the items are read from the input of the
+ *  fuzzer. The low two bits of a byte are the operation and the rest of an add
+ *  is the size of the item, whose bytes follow.
+ */
+DEF_FUZZ(fifo_survives_any_operations, data, size)
+    enum { ADD, GET, RESET, GET_TOO };
+    unsigned char items[64][32];
+    size_t sizes[64];
+    size_t num = 0;
+    size_t crnt = 0;
+    size_t pos = 0;
+    unsigned int pool = 32;
+    unsigned char out[32];
+
+    fifo_t ptr = fifo_create();
+
+    while(pos < size && num < 64) {
+        unsigned char op = data[pos++];
+        switch(op & 3) {
+            case ADD:
+                sizes[num] = (op >> 2) % 33;
+                for(size_t i = 0; i < sizes[num]; i++)
+                    items[num][i] = (pos < size) ? data[pos++] : 0;
+                fifo_add(ptr, (void*)items[num], sizes[num]);
+                pool += 24 + sizes[num];
+                num ++;
+                assert_memory_pool_size(pool);
+                break;
+
+            case GET:
+            case GET_TOO:
+                memset(out, 0xa5, sizeof(out));
+                if(crnt < num) {
+                    assert_int_equal(1, fifo_get(ptr, (void*)out, sizes[crnt]));
+                    assert_buffer_equal(items[crnt], out, sizes[crnt]);
+                    crnt ++;
+                }
+                else
+                    assert_int_equal(0, fifo_get(ptr, (void*)out, sizeof(out)));
+                break;
+
+            case RESET:
+                assert_int_equal(1, fifo_reset(ptr));
+                crnt = 0;
+                break;
+        }
+    }
+
+    fifo_destroy(ptr);
+    assert_memory_pool_size(0);
+    assert_mock_not_entered("fatal_error");
+END_FUZZ
+
+DEF_TEST_MAIN("FIFO fuzz tests")
+    TRACK_MOCK("fatal_error");
+    ADD_FUZZ(fifo_survives_any_operations);
+END_TEST_MAIN
@@ -0,0 +1,82 @@
+/*
+ *  These tests give the functions that the FIFO and its users call a latency.
+ *  The latency passes on the virtual clock, so the slow calls take no time, and
+ *  the random latencies are drawn from a seed, so they are the same every run.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#define USE_TIME 1
+#define FILE_IO_USED 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  A heavy tail gives the same latencies for the same seed, and different
+ *  latencies from one call to the next.
+ */
+DEF_TEST(write_latency_is_the_same_for_the_same_seed)
+    int64_t took[2][100];
+    int fd = open("/dev/null", O_WRONLY);
+
+    assert_int_not_equal(-1, fd);
+    for(int run = 0; run < 2; run++) {
+        set_latency_pareto(write, 1000000, 1000000000, 7);
+        for(int i = 0; i < 100; i++) {
+            uint64_t before = latency_injected;
+            assert_int_equal((int)sizeof(i), (int)write(fd, &i, sizeof(i)));
+            took[run][i] = (int64_t)(latency_injected - before);
+        }
+    }
+    close(fd);
+
+    assert_array_equal_i64(took[0], took[1], 100);
+    // the latencies are int64_t, which the int asserts would print with %d
+    int differ = took[0][0] != took[0][1];
+    assert_int_equal(1, differ);
+    assert_files_closed();
+END_TEST
+
+/*
+ *  A fixed latency on a mock is the same on every call, and it is gone once
+ *  it is cleared.
+ */
+DEF_TEST(mark_latency_is_added_to_every_add)
+    int32_t item = 1;
+    fifo_t ptr = fifo_create();
+    uint64_t before = latency_injected;
+
+    set_latency_fixed(MARK, 2000);
+    for(int i = 0; i < 10; i++)
+        fifo_add(ptr, &item, sizeof(item));
+    clear_latency(MARK);
+    assert_latency_injected(before + 10 * 2000ULL);
+    fifo_add(ptr, &item, sizeof(item));
+    assert_latency_injected(before + 10 * 2000ULL);
+    fifo_destroy(ptr);
+END_TEST
+
+DEF_TEST_MAIN("FIFO latency tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST(write_latency_is_the_same_for_the_same_seed);
+    ADD_TEST(mark_latency_is_added_to_every_add);
+END_TEST_MAIN
@@ -0,0 +1,114 @@
+/*
+ *  These tests run the same test function over rows of parameters, which come
+ *  from a table in the suite and from tests/fifo_tests_sizes.txt.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  Each row adds a number of items of one size, then checks the memory that
+ *  the FIFO uses and that the items come back in order. The rows come from a
+ *  table and from a file.
+ */
+typedef struct {
+    int count;
+    int size;
+    unsigned int pool;
+} fifo_sizes_t;
+
+static fifo_sizes_t fifo_sizes[] = {
+    { 0, 4, 32 },
+    { 1, 4, 60 },
+    { 2, 4, 88 },
+    { 3, 16, 152 },
+    { 10, 1, 282 },
+};
+
+static int parse_fifo_sizes(const char *line, size_t len, void *row) {
+
+    fifo_sizes_t *sizes = (fifo_sizes_t*)row;
+    char buf[64];
+
+    // skip blank lines and comments
+    if(len == 0 || line[0] == '#' || len >= sizeof(buf))
+        return 1;
+
+    memcpy(buf, line, len);
+    buf[len] = '\0';
+    return (3 == sscanf(buf, "%d %d %u", &sizes->count, &sizes->size, &sizes->pool)) ? 0 : 1;
+}
+
+DEF_TEST_PARAM(fifo_memory_grows_with_items, fifo_sizes_t)
+    char buf[256];
+    fifo_t ptr = fifo_create();
+
+    for(int i = 0; i < param->count; i++) {
+        memset(buf, i, param->size);
+        fifo_add(ptr, (void*)buf, param->size);
+    }
+    assert_memory_pool_size(param->pool);
+
+    for(int i = 0; i < param->count; i++) {
+        memset(buf, 0xff, sizeof(buf));
+        assert_int_equal(1, fifo_get(ptr, (void*)buf, param->size));
+        assert_int_equal(i, buf[param->size-1]);
+    }
+    assert_int_equal(0, fifo_get(ptr, (void*)buf, param->size));
+
+    fifo_destroy(ptr);
+    assert_memory_pool_size(0);
+    assert_mock_not_entered("fatal_error");
+END_TEST_PARAM
+
+DEF_TEST_PARAM(fifo_memory_grows_with_items_from_file, fifo_sizes_t)
+    fifo_memory_grows_with_items(test, param);
+END_TEST_PARAM
+
+/*
+ *  Any line at all can be given to the parser of the file of sizes. A line
+ *  that it accepts has to read back the same after it is printed.
+ */
+DEF_FUZZ(parse_fifo_sizes_accepts_any_line, data, size)
+    fifo_sizes_t row;
+    fifo_sizes_t again;
+    char line[64];
+
+    memset(&row, 0, sizeof(row));
+    if(0 == parse_fifo_sizes((const char*)data, size, &row)) {
+        int len = snprintf(line, sizeof(line), "%d %d %u", row.count, row.size, row.pool);
+        memset(&again, 0, sizeof(again));
+        assert_int_equal(0, parse_fifo_sizes(line, len, &again));
+        assert_int_equal(row.count, again.count);
+        assert_int_equal(row.size, again.size);
+        assert_uint_equal(row.pool, again.pool);
+    }
+END_FUZZ
+
+DEF_TEST_MAIN("FIFO parameterized tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST_PARAM(fifo_memory_grows_with_items, fifo_sizes);
+    ADD_TEST_PARAM_FILE(fifo_memory_grows_with_items_from_file, "tests/fifo_tests_sizes.txt", parse_fifo_sizes);
+    ADD_FUZZ(parse_fifo_sizes_accepts_any_line);
+END_TEST_MAIN
@@ -0,0 +1,84 @@
+/*
+ *  These tests run the FIFO through sequences of operations that are generated
+ *  at random, and compare it against a list.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  Any sequence of adds, gets and resets has to behave like a list with a
+ *  read position, for payloads from 0 to 32 bytes, and the memory in use
+ *  always has to match the items that were added.
+ */
+DEF_PROPERTY(fifo_behaves_like_a_list)
+    enum { ADD, GET, RESET };
+    unsigned char *items[64];
+    size_t sizes[64];
+    size_t num = 0;
+    size_t crnt = 0;
+    size_t nops;
+    unsigned int pool = 32;
+    unsigned char out[32];
+
+    fifo_t ptr = fifo_create();
+    int *ops = gen_ops(3, 0, 64, &nops);
+
+    for(size_t i = 0; i < nops; i++) {
+        switch(ops[i]) {
+            case ADD:
+                items[num] = gen_buffer(0, 32, &sizes[num]);
+                fifo_add(ptr, (void*)items[num], sizes[num]);
+                pool += 24 + sizes[num];
+                num ++;
+                assert_memory_pool_size(pool);
+                break;
+
+            case GET:
+                memset(out, 0xa5, sizeof(out));
+                if(crnt < num) {
+                    assert_int_equal(1, fifo_get(ptr, (void*)out, sizes[crnt]));
+                    assert_buffer_equal(items[crnt], out, sizes[crnt]);
+                    crnt ++;
+                }
+                else
+                    assert_int_equal(0, fifo_get(ptr, (void*)out, sizeof(out)));
+                break;
+
+            case RESET:
+                assert_int_equal(1, fifo_reset(ptr));
+                crnt = 0;
+                break;
+        }
+    }
+
+    fifo_destroy(ptr);
+    assert_memory_pool_size(0);
+    assert_mock_not_entered("fatal_error");
+END_PROPERTY
+
+DEF_TEST_MAIN("FIFO property tests")
+    TRACK_MOCK("fatal_error");
+    ADD_PROPERTY(fifo_behaves_like_a_list, 10000);
+END_TEST_MAIN
@@ -0,0 +1,206 @@
+/*
+ *  These tests check the latency histogram of unit_hist.h against values that
+ *  are known, then use it for the statistics that the FIFO keeps when it is
+ *  compiled with FIFO_STATS. The suite does not set USE_TIME, so the FIFO reads
+ *  the real clock and the statistics are of the FIFO itself.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#include <pthread.h>
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#define FIFO_STATS 1
+#include "fifo.c"
+
+/*
+ *  Values below 128 are counted exactly, so every percentile of 0 to 99 is
+ *  known.
+ */
+DEF_TEST(unit_hist_counts_small_values_exactly)
+    unit_hist_t h;
+
+    unit_hist_init(&h);
+    assert_uint_equal(0, (unsigned int)unit_hist_percentile(&h, 50));
+    for(int i = 99; i >= 0; i--)
+        unit_hist_record(&h, i);
+
+    assert_uint_equal(100, (unsigned int)h.count);
+    assert_uint_equal(0, (unsigned int)h.min);
+    assert_uint_equal(99, (unsigned int)h.max);
+    assert_uint_equal(49, (unsigned int)unit_hist_mean(&h));
+    assert_uint_equal(0, (unsigned int)unit_hist_percentile(&h, 1));
+    assert_uint_equal(49, (unsigned int)unit_hist_percentile(&h, 50));
+    assert_uint_equal(98, (unsigned int)unit_hist_percentile(&h, 99));
+    assert_uint_equal(99, (unsigned int)unit_hist_percentile(&h, 100));
+END_TEST
+
+/*
+ *  A larger value is in a bucket whose top is at most 1 part in 64 above it,
+ *  and the buckets are in the order of their values.
+ */
+DEF_TEST(unit_hist_keeps_values_to_1_part_in_64)
+    unit_hist_t h;
+    int wrong = 0;
+    int last = 0;
+
+    for(uint64_t v = 128; v < (1ULL << 39); v += v / 37 + 1) {
+        int idx = unit_hist_index(v);
+        uint64_t top = unit_hist_value(idx);
+        if(top < v || top - v > v / 64 || idx < last)
+            wrong ++;
+        last = idx;
+    }
+    assert_int_equal(0, wrong);
+
+    // 500 is in the bucket of 500 to 503, and a percentile is never more than the largest value
+    assert_uint_equal(503, (unsigned int)unit_hist_value(unit_hist_index(500)));
+    unit_hist_init(&h);
+    unit_hist_record(&h, 500);
+    assert_uint_equal(500, (unsigned int)unit_hist_percentile(&h, 50));
+    unit_hist_record(&h, 1000);
+    assert_uint_equal(503, (unsigned int)unit_hist_percentile(&h, 50));
+    assert_uint_equal(1000, (unsigned int)unit_hist_percentile(&h, 100));
+    assert_percentile_below(&h, 50, 504);
+END_TEST
+
+DEF_TEST(unit_hist_merge_adds_the_counts)
+    unit_hist_t a, b;
+
+    unit_hist_init(&a);
+    unit_hist_init(&b);
+    for(int i = 0; i < 50; i++)
+        unit_hist_record(&a, 10);
+    for(int i = 0; i < 50; i++)
+        unit_hist_record(&b, 20);
+    unit_hist_record(&b, 1000000);
+
+    unit_hist_merge(&a, &b);
+    assert_uint_equal(101, (unsigned int)a.count);
+    assert_uint_equal(10, (unsigned int)a.min);
+    assert_uint_equal(1000000, (unsigned int)a.max);
+    assert_uint_equal(50 * 10 + 50 * 20 + 1000000, (unsigned int)a.sum);
+    assert_uint_equal(10, (unsigned int)unit_hist_percentile(&a, 40));
+    assert_uint_equal(20, (unsigned int)unit_hist_percentile(&a, 99));
+    assert_uint_equal(1000000, (unsigned int)unit_hist_percentile(&a, 100));
+END_TEST
+
+/*
+ *  Every add and get is timed, including the get that finds the FIFO empty.
+ *  How long they take depends on the machine, so the bounds are loose: an add
+ *  or a get of four bytes takes well under a millisecond, and the percentiles
+ *  are in order between the fastest and the slowest call.
+ */
+DEF_TEST(fifo_stats_time_every_add_and_get)
+    int32_t item = 1;
+    fifo_t ptr = fifo_create();
+
+    unit_hist_init(&fifo_add_ns);
+    unit_hist_init(&fifo_get_ns);
+    for(int i = 0; i < 10000; i++)
+        fifo_add(ptr, &item, sizeof(item));
+    while(fifo_get(ptr, &item, sizeof(item)))
+        ;
+    fifo_destroy(ptr);
+
+    if(unit_verbose >= 2) {
+        unit_hist_print(&fifo_add_ns, "fifo_add", stdout);
+        unit_hist_print(&fifo_get_ns, "fifo_get", stdout);
+    }
+    assert_uint_equal(10000, (unsigned int)fifo_add_ns.count);
+    assert_uint_equal(10001, (unsigned int)fifo_get_ns.count);
+    assert_percentile_below(&fifo_add_ns, 50, 1000000);
+    assert_percentile_below(&fifo_get_ns, 50, 1000000);
+
+    int ordered = fifo_add_ns.min <= unit_hist_percentile(&fifo_add_ns, 50) &&
+                  unit_hist_percentile(&fifo_add_ns, 50) <= unit_hist_percentile(&fifo_add_ns, 99) &&
+                  unit_hist_percentile(&fifo_add_ns, 99) <= fifo_add_ns.max;
+    assert_int_equal(1, ordered);
+END_TEST
+
+/*
+ *  Every thread adds and gets its own number of items and copies out the
+ *  histograms that it recorded into. The calls of the test driver to the mocks
+ *  and to the memory statistics are not locked, so the threads run one after
+ *  the other, which is enough to show that none of them sees the calls of
+ *  another.
+ */
+#define STATS_THREADS 4
+
+typedef struct {
+    int items;
+    unit_hist_t add_ns;
+    unit_hist_t get_ns;
+} stats_thread_t;
+
+static void *stats_thread(void *arg) {
+
+    stats_thread_t *st = (stats_thread_t *)arg;
+    int32_t item = 1;
+    fifo_t ptr = fifo_create();
+
+    for(int i = 0; i < st->items; i++)
+        fifo_add(ptr, &item, sizeof(item));
+    while(fifo_get(ptr, &item, sizeof(item)))
+        ;
+    fifo_destroy(ptr);
+    st->add_ns = fifo_add_ns;
+    st->get_ns = fifo_get_ns;
+    return NULL;
+}
+
+DEF_TEST(fifo_stats_are_kept_per_thread_and_merged)
+    static stats_thread_t st[STATS_THREADS];
+    unit_hist_t add_ns, get_ns;
+    pthread_t tid;
+    int started = 0;
+
+    unit_hist_init(&fifo_add_ns);
+    unit_hist_init(&add_ns);
+    unit_hist_init(&get_ns);
+    for(int i = 0; i < STATS_THREADS; i++) {
+        st[i].items = 100 * (i + 1);
+        if(pthread_create(&tid, NULL, stats_thread, &st[i]) == 0 && pthread_join(tid, NULL) == 0)
+            started ++;
+    }
+    assert_int_equal(STATS_THREADS, started);
+
+    for(int i = 0; i < STATS_THREADS; i++) {
+        assert_uint_equal(100u * (i + 1), (unsigned int)st[i].add_ns.count);
+        assert_uint_equal(100u * (i + 1) + 1, (unsigned int)st[i].get_ns.count);
+        unit_hist_merge(&add_ns, &st[i].add_ns);
+        unit_hist_merge(&get_ns, &st[i].get_ns);
+    }
+    // this thread made no calls of its own
+    assert_uint_equal(0, (unsigned int)fifo_add_ns.count);
+    assert_uint_equal(100 + 200 + 300 + 400, (unsigned int)add_ns.count);
+    assert_uint_equal(100 + 200 + 300 + 400 + STATS_THREADS, (unsigned int)get_ns.count);
+    assert_percentile_below(&add_ns, 50, 1000000);
+END_TEST
+
+DEF_TEST_MAIN("FIFO statistics tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST(unit_hist_counts_small_values_exactly);
+    ADD_TEST(unit_hist_keeps_values_to_1_part_in_64);
+    ADD_TEST(unit_hist_merge_adds_the_counts);
+    ADD_TEST(fifo_stats_time_every_add_and_get);
+    ADD_TEST(fifo_stats_are_kept_per_thread_and_merged);
+END_TEST_MAIN
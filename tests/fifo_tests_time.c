@@ -0,0 +1,102 @@
+/*
+ *  These tests run on a virtual clock. Sleeping moves the clock on without
+ *  waiting, so a consumer that backs off for 30 seconds is tested at once and
+ *  always sees the same times.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#define USE_TIME 1
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  A consumer that waits for an item, as a user of the FIFO would. It polls
+ *  the FIFO with a backoff that doubles up to 100 ms and gives up after the
+ *  timeout. The clock is virtual, so waiting 30 seconds takes no time at all.
+ */
+static int fifo_get_wait(fifo_t fifo, void *data, size_t size, unsigned int timeout_ms) {
+
+    struct timespec start, now;
+    useconds_t backoff = 1000;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(;;) {
+        if(fifo_get(fifo, data, size))
+            return 1;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long elapsed = (now.tv_sec - start.tv_sec) * 1000LL +
+                            (now.tv_nsec - start.tv_nsec) / 1000000;
+        if(elapsed >= timeout_ms)
+            return 0;
+
+        usleep(backoff);
+        backoff = (backoff * 2 > 100000) ? 100000 : backoff * 2;
+    }
+}
+
+DEF_TEST(fifo_get_wait_returns_waiting_item)
+    int in = 42, out = 0;
+    fifo_t ptr = fifo_create();
+
+    fifo_add(ptr, &in, sizeof(in));
+    assert_int_equal(1, fifo_get_wait(ptr, &out, sizeof(out), 30000));
+    assert_int_equal(42, out);
+    assert_sleep_not_entered();
+    fifo_destroy(ptr);
+END_TEST
+
+DEF_TEST(fifo_get_wait_gives_up_after_timeout)
+    int out = 0;
+    fifo_t ptr = fifo_create();
+
+    // 1, 2, 4, ... 64 ms, then 100 ms until 30 s have passed
+    assert_int_equal(0, fifo_get_wait(ptr, &out, sizeof(out), 30000));
+    assert_sleep_entered_count(7 + 299);
+    assert_time_slept(30027000000ULL);
+    fifo_destroy(ptr);
+END_TEST
+
+/*
+ *  Every get takes 10 ms, which the consumer counts against its timeout, so
+ *  it sleeps fewer times than it would with fast gets. The latency is on the
+ *  virtual clock, so the test still takes no time at all.
+ */
+DEF_TEST(fifo_get_wait_counts_slow_gets_against_timeout)
+    int out = 0;
+    fifo_t ptr = fifo_create();
+
+    set_latency_fixed(MARK, 10000000);
+    assert_int_equal(0, fifo_get_wait(ptr, &out, sizeof(out), 1000));
+    assert_sleep_entered_count(7 + 8);
+    assert_latency_injected(16 * 10000000ULL);
+    clear_latency(MARK);
+    fifo_destroy(ptr);
+END_TEST
+
+DEF_TEST_MAIN("FIFO virtual clock tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST(fifo_get_wait_returns_waiting_item);
+    ADD_TEST(fifo_get_wait_gives_up_after_timeout);
+    ADD_TEST(fifo_get_wait_counts_slow_gets_against_timeout);
+END_TEST_MAIN
@@ -0,0 +1,77 @@
+/*
+ *  These tests run under a time limit. Every test of the suite has TEST_TIMEOUT
+ *  to finish, so a FIFO that loops forever fails the test instead of holding up
+ *  the suite, and the slowest test has a limit of its own.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#define TEST_TIMEOUT 10000
+#include "unit_tests.h"
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  Define tests.
+ */
+DEF_TEST(fifo_get_ends_on_an_empty_fifo)
+    int32_t item = 1;
+    fifo_t ptr = fifo_create();
+
+    fifo_add(ptr, &item, sizeof(item));
+    assert_int_equal(1, fifo_get(ptr, &item, sizeof(item)));
+    for(int i = 0; i < 1000; i++)
+        assert_int_equal(0, fifo_get(ptr, &item, sizeof(item)));
+    fifo_destroy(ptr);
+    assert_memory_pool_size(0);
+END_TEST
+
+/*
+ *  A hundred thousand items, added and read back twice, take well under a
+ *  second. A FIFO that walks its whole list on every add would not finish in
+ *  time.
+ */
+DEF_TEST(fifo_handles_many_items_in_time)
+    int32_t item;
+    int wrong;
+    fifo_t ptr = fifo_create();
+
+    for(int32_t i = 0; i < 100000; i++)
+        fifo_add(ptr, &i, sizeof(i));
+    for(int run = 0; run < 2; run++) {
+        wrong = 0;
+        for(int32_t i = 0; i < 100000; i++)
+            if(!fifo_get(ptr, &item, sizeof(item)) || item != i)
+                wrong ++;
+        assert_int_equal(0, wrong);
+        assert_int_equal(0, fifo_get(ptr, &item, sizeof(item)));
+        assert_int_equal(1, fifo_reset(ptr));
+    }
+    fifo_destroy(ptr);
+    assert_memory_pool_size(0);
+END_TEST
+
+DEF_TEST_MAIN("FIFO timeout tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST(fifo_get_ends_on_an_empty_fifo);
+    ADD_TEST(fifo_handles_many_items_in_time);
+    SET_TIMEOUT(fifo_handles_many_items_in_time, 5000);
+END_TEST_MAIN
@@ -18,7 +18,7 @@ DEF_MOCK(void, MARK, void)
     // normally, this would print a message. Here it does nothing.
 END_MOCK
 
-DEF_MOCK(void, fatal_error, char *str, ...)
+DEF_MOCK(void, fatal_error, const char *str, ...)
     // Normally, this function prints an error and kills the program. Here it
     // does nothing.
     (void)str;
@@ -93,7 +93,8 @@ END_TEST
 DEF_TEST(fifo_items_are_returned_in_order)
     fifo_t ptr = fifo_create();
     assert_memory_pool_size(32);
-    assert_memory_total_size(64);
+    // only counts what this test allocated, whichever tests ran before it
+    assert_memory_total_size(32);
     assert_calloc_entered_count(1);
 
     int value = 1;
@@ -189,6 +190,100 @@ DEF_TEST(single_item_returns_after_reset)
 
 END_TEST
 
+/*
+ *  An item that is added after every item was read is the next one that is
+ *  returned.
+ */
+DEF_TEST(item_added_after_drain_is_returned)
+    fifo_t ptr = fifo_create();
+
+    int value = 123;
+    fifo_add(ptr, (void*)&value, sizeof(int));
+    int retv = fifo_get(ptr, (void*)&value, sizeof(int));
+    assert_int_equal(1, retv);
+    retv = fifo_get(ptr, (void*)&value, sizeof(int));
+    assert_int_equal(0, retv);
+
+    value = 456;
+    fifo_add(ptr, (void*)&value, sizeof(int));
+    value = 0;
+    retv = fifo_get(ptr, (void*)&value, sizeof(int));
+    assert_int_equal(1, retv);
+    assert_int_equal(456, value);
+
+    retv = fifo_get(ptr, (void*)&value, sizeof(int));
+    assert_int_equal(0, retv);
+
+    fifo_destroy(ptr);
+    assert_memory_pool_size(0);
+    assert_mock_not_entered("fatal_error");
+END_TEST
+
+/*
+ *  Whole arrays go through the FIFO as one item each and come back intact.
+ */
+DEF_TEST(fifo_returns_arrays_intact)
+    static int32_t ints[1024], int_copy[1024];
+    static int64_t longs[1024], long_copy[1024];
+    static float floats[1024], float_copy[1024];
+    static double doubles[1024], double_copy[1024];
+
+    for(int i = 0; i < 1024; i++) {
+        ints[i] = i * 7919 - 4000000;
+        longs[i] = (int64_t)ints[i] << 20;
+        floats[i] = (float)i / 3.0f;
+        doubles[i] = (double)i / 3.0;
+    }
+
+    fifo_t ptr = fifo_create();
+    fifo_add(ptr, ints, sizeof(ints));
+    fifo_add(ptr, longs, sizeof(longs));
+    fifo_add(ptr, floats, sizeof(floats));
+    fifo_add(ptr, doubles, sizeof(doubles));
+
+    assert_int_equal(1, fifo_get(ptr, int_copy, sizeof(int_copy)));
+    assert_int_equal(1, fifo_get(ptr, long_copy, sizeof(long_copy)));
+    assert_int_equal(1, fifo_get(ptr, float_copy, sizeof(float_copy)));
+    assert_int_equal(1, fifo_get(ptr, double_copy, sizeof(double_copy)));
+    fifo_destroy(ptr);
+
+    assert_array_equal_i32(ints, int_copy, 1024);
+    assert_array_equal_i64(longs, long_copy, 1024);
+    assert_array_equal_f32(floats, float_copy, 1024);
+    assert_array_equal_f64(doubles, double_copy, 1024);
+
+    // the values that are worked out again round differently
+    for(int i = 0; i < 1024; i++) {
+        float_copy[i] = (float)i * (1.0f / 3.0f);
+        double_copy[i] = (double)i * (1.0 / 3.0);
+    }
+    assert_array_ulps_f32(floats, float_copy, 1024, 2);
+    assert_array_near_f64(doubles, double_copy, 1024, 1e-12);
+
+    assert_memory_pool_size(0);
+    assert_mock_not_entered("fatal_error");
+END_TEST
+
+/*
+ *  The items are printed one to a line as they come out of the FIFO, and the
+ *  text is checked against a golden file.
+ */
+DEF_TEST(fifo_output_matches_golden)
+    static const char items[][16] = { "first", "second", "third", "fourth", "fifth" };
+    char out[256], item[16];
+    size_t len = 0;
+
+    fifo_t ptr = fifo_create();
+    for(int i = 0; i < 5; i++)
+        fifo_add(ptr, (void*)items[i], sizeof(items[i]));
+    for(int i = 0; fifo_get(ptr, item, sizeof(item)); i++)
+        len += snprintf(&out[len], sizeof(out) - len, "%d: %s\n", i, item);
+    fifo_destroy(ptr);
+
+    assert_matches_golden(out, len, "tests/golden/fifo_items_in_order.txt");
+    assert_memory_pool_size(0);
+END_TEST
+
 /*
  *  Define the actual main. There is a lot more to this than you see here. You
  *  can really do anything here that you could do in any other main(), but this
@@ -200,5 +295,8 @@ DEF_TEST_MAIN("FIFO tests using malloc")
     ADD_TEST(fifo_items_are_returned_in_order);
     ADD_TEST(empty_fifo_returns_error_on_get);
     ADD_TEST(single_item_returns_after_reset);
+    ADD_TEST(item_added_after_drain_is_returned);
     ADD_TEST(empty_list_reset_no_error);
+    ADD_TEST(fifo_returns_arrays_intact);
+    ADD_TEST(fifo_output_matches_golden);
 END_TEST_MAIN
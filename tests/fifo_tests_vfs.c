@@ -0,0 +1,130 @@
+/*
+ *  These tests run on a filesystem in memory. The files that the FIFO and its
+ *  users open, read, write and map are kept by the test driver, so the tests
+ *  leave nothing behind, and a disk that is full or reads that come back short
+ *  can be made up.
+ */
+#define USE_MEMORY 1
+#define VERBOSE 1
+#define FILE_IO_USED 1
+#define USE_VFS 1
+#include "unit_tests.h"
+#include <errno.h>
+
+/*
+ *  Define symbols so that the module under test can actually link.
+ */
+typedef void* fifo_t;
+
+DEF_MOCK(void, MARK, void)
+    // normally, this would print a message. Here it does nothing.
+END_MOCK
+
+DEF_MOCK(void, fatal_error, const char *str, ...)
+    // Normally, this function prints an error and kills the program. Here it
+    // does nothing.
+    (void)str;
+END_MOCK
+
+/*
+ *  Include the module directly, without the header. Note that any headers
+ *  included by the module under test have to be stubbed out for it to compile.
+ */
+#include "fifo.c"
+
+/*
+ *  Write the items in the FIFO to a file, as many as fit in a block at a time,
+ *  so that a FIFO of small items does not take a system call for each one.
+ */
+static void fifo_save(fifo_t fifo, int fd, size_t size) {
+
+    char block[4096];
+    size_t used = 0;
+
+    while(fifo_get(fifo, &block[used], size)) {
+        used += size;
+        if(used + size > sizeof(block)) {
+            if(write(fd, block, used) != (ssize_t)used)
+                return;
+            used = 0;
+        }
+    }
+    if(used > 0)
+        write(fd, block, used);
+}
+
+/*
+ *  The disk can be made to fill up part way through a block.
+ */
+DEF_TEST(fifo_save_stops_when_the_disk_is_full)
+    static int32_t items[3000];
+    fifo_t ptr = fifo_create();
+
+    for(int i = 0; i < 3000; i++) {
+        items[i] = i;
+        fifo_add(ptr, &items[i], sizeof(int32_t));
+    }
+
+    set_vfs_space(5000);
+    int fd = open("fifo.dat", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert_int_not_equal(-1, fd);
+    fifo_save(ptr, fd, sizeof(int32_t));
+
+    // the second block is cut short, and nothing more fits after it
+    assert_io_entered_count(write, 2);
+    assert_vfs_file_size("fifo.dat", 5000);
+    assert_vfs_file_equal("fifo.dat", items, 5000);
+    assert_int_equal(-1, (int)write(fd, items, 1));
+    assert_int_equal(ENOSPC, errno);
+
+    close(fd);
+    fifo_destroy(ptr);
+    assert_files_closed();
+END_TEST
+
+DEF_TEST(fifo_save_can_be_mapped_back)
+    static int32_t items[3000];
+    fifo_t ptr = fifo_create();
+
+    for(int i = 0; i < 3000; i++) {
+        items[i] = i * 7;
+        fifo_add(ptr, &items[i], sizeof(int32_t));
+    }
+
+    int fd = open("fifo.dat", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert_int_not_equal(-1, fd);
+    fifo_save(ptr, fd, sizeof(int32_t));
+    fifo_destroy(ptr);
+
+    int32_t *map = mmap(NULL, sizeof(items), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert_int_not_equal(-1, (int)(intptr_t)map);
+    close(fd);
+    assert_array_equal_i32(items, map, 3000);
+
+    // a shared mapping is written back to the file when it is unmapped
+    map[0] = items[0] = -1;
+    assert_int_equal(0, munmap(map, sizeof(items)));
+    assert_vfs_file_equal("fifo.dat", items, sizeof(items));
+
+    // short reads still read every item
+    set_vfs_short_read(10);
+    fd = open("fifo.dat", O_RDONLY);
+    int32_t first = 0;
+    assert_int_equal(4, (int)read(fd, &first, sizeof(first)));
+    assert_int_equal(-1, first);
+    assert_int_equal(6, (int)read(fd, &items[1], 6));
+    assert_int_equal(0, (int)lseek(fd, 0, SEEK_SET));
+    close(fd);
+    assert_int_equal(0, unlink("fifo.dat"));
+    assert_io_entered_count(mmap, 1);
+    assert_io_entered_count(munmap, 1);
+    assert_io_entered_count(lseek, 1);
+    assert_io_entered_count(unlink, 1);
+    assert_files_closed();
+END_TEST
+
+DEF_TEST_MAIN("FIFO filesystem in memory tests")
+    TRACK_MOCK("fatal_error");
+    ADD_TEST(fifo_save_stops_when_the_disk_is_full);
+    ADD_TEST(fifo_save_can_be_mapped_back);
+END_TEST_MAIN
@@ -0,0 +1,105 @@
+/*
+ *  These tests use the same FIFO object that the program links with. The
+ *  module is compiled on its own at the optimization level that ships and the
+ *  functions it calls are replaced at link time with wrapped mocks. See the
+ *  Makefile for the --wrap options that this suite is linked with.
+ */
+#define USE_MEMORY 0
+#define USE_CAPTURE 1
+#define VERBOSE 1
+#include "unit_tests.h"
+#include "fifo.h"
+
+static const char *fatal_error_str;
+DEF_WRAP_MOCK(void, fatal_error, const char *fmt, ...)
+    fatal_error_str = fmt;
+    RAISE();
+END_WRAP_MOCK
+
+DEF_WRAP_MOCK(void, MARK, void)
+END_WRAP_MOCK
+
+/*
+ *  The number of calls to calloc() that succeed before it returns NULL. A
+ *  negative number means that it always succeeds.
+ */
+static int calloc_passes = -1;
+DEF_WRAP_MOCK(void*, calloc, size_t num, size_t size)
+    if(calloc_passes == 0)
+        return NULL;
+    if(calloc_passes > 0)
+        calloc_passes --;
+    return REAL(calloc)(num, size);
+END_WRAP_MOCK
+
+static int malloc_fails = 0;
+DEF_WRAP_MOCK(void*, malloc, size_t size)
+    if(malloc_fails)
+        return NULL;
+    return REAL(malloc)(size);
+END_WRAP_MOCK
+
+DEF_TEST(fifo_items_are_returned_in_order)
+    calloc_passes = -1;
+    malloc_fails = 0;
+    fifo_t ptr = fifo_create();
+    assert_ptr_not_null(ptr);
+
+    for(int i = 0; i < 100; i++)
+        fifo_add(ptr, &i, sizeof(int));
+    assert_mock_entered_count(101, "calloc");
+    assert_mock_entered_count(100, "malloc");
+
+    int value = -1;
+    for(int i = 0; i < 100; i++) {
+        int retv = fifo_get(ptr, &value, sizeof(int));
+        if(retv != 1 || value != i) {
+            assert_int_equal(i, value);
+            break;
+        }
+    }
+    assert_int_equal(0, fifo_get(ptr, &value, sizeof(int)));
+
+    fifo_destroy(ptr);
+    assert_mock_not_entered("fatal_error");
+END_TEST
+
+DEF_TEST(fifo_create_fails_data_structure)
+    calloc_passes = 0;
+    CAPTURE
+        fifo_create();
+    END_CAPTURE
+    assert_mock_entered("fatal_error");
+    assert_string_equal("cannot allocate memory for FIFO struct", fatal_error_str);
+END_TEST
+
+DEF_TEST(fifo_add_fatal_error_on_failed_allocate)
+    calloc_passes = 1;
+    malloc_fails = 0;
+    fifo_t ptr = fifo_create();
+    assert_ptr_not_null(ptr);
+
+    CAPTURE
+        fifo_add(ptr, NULL, 0);
+    END_CAPTURE
+    assert_mock_entered_count(1, "fatal_error");
+    assert_string_equal("cannot allocate memory for FIFO element", fatal_error_str);
+
+    calloc_passes = -1;
+    malloc_fails = 1;
+    CAPTURE
+        fifo_add(ptr, NULL, 0);
+    END_CAPTURE
+    assert_mock_entered_count(2, "fatal_error");
+    assert_string_equal("cannot allocate memory for FIFO element data", fatal_error_str);
+    // the FIFO is left with partial elements, so it is not destroyed here
+END_TEST
+
+DEF_TEST_MAIN("FIFO tests with wrapped mocks")
+    TRACK_MOCK("fatal_error");
+    TRACK_MOCK("calloc");
+    TRACK_MOCK("malloc");
+    ADD_TEST(fifo_items_are_returned_in_order);
+    ADD_TEST(fifo_create_fails_data_structure);
+    ADD_TEST(fifo_add_fatal_error_on_failed_allocate);
+END_TEST_MAIN
@@ -0,0 +1,147 @@
+/*
+ *  Latency histogram. This is a log-linear histogram in the style of HDR
+ *  histograms, for recording how long something takes in nanoseconds and for
+ *  asking what the tail of it looks like afterwards. An average hides the slow
+ *  calls, a percentile does not.
+ *
+ *  Values below UNIT_HIST_SUB are counted exactly. Above that, every power of
+ *  two is split into UNIT_HIST_SUB / 2 buckets of the same width, so a value
+ *  is known to within 1 part in 64 of itself, whatever its size. Recording a
+ *  value takes a count of the leading zeros and an add, and the histogram is
+ *  a fixed size, so it can be recorded into from anywhere and never allocates.
+ *  Values from 2^UNIT_HIST_MAX_BITS ns (about 18 minutes) up are counted in
+ *  the last bucket.
+ *
+ *  A histogram is not locked. Every thread records into one of its own, and
+ *  they are merged into one when the threads are done.
+ *
+ *  This file does not need the rest of the test framework, so the code under
+ *  test can include it for its own statistics.
+ */
+#ifndef _UNIT_HIST_H_
+#define _UNIT_HIST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define UNIT_HIST_SUB_BITS  7
+#define UNIT_HIST_MAX_BITS  40
+#define UNIT_HIST_SUB       (1 << UNIT_HIST_SUB_BITS)
+#define UNIT_HIST_BUCKETS   ((UNIT_HIST_MAX_BITS - UNIT_HIST_SUB_BITS + 2) * (UNIT_HIST_SUB / 2))
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[UNIT_HIST_BUCKETS];
+} unit_hist_t;
+
+static inline void unit_hist_init(unit_hist_t *h) {
+
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+/*
+ *  A value of 2^e or more, for e of UNIT_HIST_SUB_BITS or more, is shifted
+ *  right until it has UNIT_HIST_SUB_BITS bits, which leaves it between
+ *  UNIT_HIST_SUB / 2 and UNIT_HIST_SUB. The shift picks the power of two and
+ *  what is left picks the bucket in it.
+ */
+static inline int unit_hist_index(uint64_t v) {
+
+    if(v < UNIT_HIST_SUB)
+        return (int)v;
+
+    int shift = 64 - __builtin_clzll(v) - UNIT_HIST_SUB_BITS;
+    int idx = shift * (UNIT_HIST_SUB / 2) + (int)(v >> shift);
+    return (idx < UNIT_HIST_BUCKETS) ? idx : UNIT_HIST_BUCKETS - 1;
+}
+
+/*
+ *  The largest value that is counted in a bucket.
+ */
+static inline uint64_t unit_hist_value(int idx) {
+
+    if(idx < UNIT_HIST_SUB)
+        return (uint64_t)idx;
+
+    int shift = idx / (UNIT_HIST_SUB / 2) - 1;
+    uint64_t sub = (uint64_t)(idx - shift * (UNIT_HIST_SUB / 2));
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline void unit_hist_record(unit_hist_t *h, uint64_t v) {
+
+    h->counts[unit_hist_index(v)] ++;
+    h->count ++;
+    h->sum += v;
+    if(v < h->min)
+        h->min = v;
+    if(v > h->max)
+        h->max = v;
+}
+
+static inline void unit_hist_merge(unit_hist_t *to, const unit_hist_t *from) {
+
+    for(int i = 0; i < UNIT_HIST_BUCKETS; i++)
+        to->counts[i] += from->counts[i];
+    to->count += from->count;
+    to->sum += from->sum;
+    if(from->min < to->min)
+        to->min = from->min;
+    if(from->max > to->max)
+        to->max = from->max;
+}
+
+/*
+ *  The value that p percent of the values are at or below, such as 99.9 for
+ *  the slowest call in a thousand. It is the top of the bucket that the value
+ *  is in, so it is never less than the value itself. An empty histogram
+ *  gives 0.
+ */
+static inline uint64_t unit_hist_percentile(const unit_hist_t *h, double p) {
+
+    double r = p / 100.0 * (double)h->count;
+    uint64_t rank = (uint64_t)r;
+    uint64_t seen = 0;
+
+    if(h->count == 0)
+        return 0;
+    if((double)rank < r)
+        rank ++;
+    if(rank == 0)
+        rank = 1;
+
+    for(int i = 0; i < UNIT_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if(seen >= rank) {
+            uint64_t v = unit_hist_value(i);
+            return (v < h->max) ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+static inline uint64_t unit_hist_mean(const unit_hist_t *h) {
+
+    return (h->count > 0) ? h->sum / h->count : 0;
+}
+
+static inline void unit_hist_print(const unit_hist_t *h, const char *name, FILE *fp) {
+
+    fprintf(fp, "%s: count: %llu, min: %llu, mean: %llu, p50: %llu, p90: %llu, "
+            "p99: %llu, p99.9: %llu, max: %llu\n", name,
+            (unsigned long long)h->count,
+            (unsigned long long)(h->count > 0 ? h->min : 0),
+            (unsigned long long)unit_hist_mean(h),
+            (unsigned long long)unit_hist_percentile(h, 50.0),
+            (unsigned long long)unit_hist_percentile(h, 90.0),
+            (unsigned long long)unit_hist_percentile(h, 99.0),
+            (unsigned long long)unit_hist_percentile(h, 99.9),
+            (unsigned long long)h->max);
+}
+
+#endif /* _UNIT_HIST_H_ */
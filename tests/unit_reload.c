@@ -0,0 +1,8 @@
+/*
+ *  The main function of a reloading test runner. The test suites are given on
+ *  the command line as shared objects that are compiled with UNIT_RUNNER. They
+ *  are run once and then run again every time one of them is rebuilt.
+ */
+#include "unit_tests.h"
+
+DEF_RELOAD_MAIN
@@ -0,0 +1,8 @@
+/*
+ *  The main function of a test runner. Every test suite that is compiled with
+ *  UNIT_RUNNER and linked with this file registers itself at start-up, and
+ *  all of them are run, one after the other, by the runner.
+ */
+#include "unit_tests.h"
+
+DEF_RUNNER_MAIN
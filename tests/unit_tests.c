@@ -0,0 +1,4850 @@
+/*
+ * This is the test driver that implements the macros in unit_tests.h. It is
+ * not meant to be edited for a test suite.
+ *
+ * By default, unit_tests.h includes this file and everything in it is static
+ * to the test suite. When USE_SPLIT is 1, this file is compiled once to an
+ * object file that is linked with every test suite instead. Everything that a
+ * test suite can enable is built in that case, so that one object works for
+ * all of them. The test suite passes its settings to unit_init() at run time.
+ */
+#ifndef _UNIT_TESTS_H_
+#define UNIT_TESTS_IMPLEMENTATION
+#undef USE_SPLIT
+#define USE_SPLIT 1
+#undef USE_MEMORY
+#define USE_MEMORY 1
+#undef USE_CAPTURE
+#define USE_CAPTURE 1
+#undef USE_TIME
+#define USE_TIME 1
+#undef FILE_IO_USED
+#define FILE_IO_USED 1
+#include "unit_tests.h"
+#endif
+
+#include <fnmatch.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <link.h>
+#if USE_SPLIT == 1
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+UNIT_DATA const char *suite_name = NULL;
+UNIT_DATA int unit_verbose = VERBOSE;
+UNIT_DATA int unit_isolation = USE_ISOLATION;
+UNIT_DATA int unit_use_memory = USE_MEMORY;
+UNIT_DATA int unit_use_vfs = USE_VFS;
+UNIT_DATA int unit_use_time = USE_TIME;
+
+UNIT_DATA mock_list_t mocks[MAX_MOCKS];
+UNIT_DATA int mock_idx = 0;
+UNIT_DATA mock_list_t stubs[MAX_STUBS];
+UNIT_DATA int stub_idx = 0;
+UNIT_DATA test_list_t tests[MAX_TESTS];
+UNIT_DATA int test_idx = 0;
+UNIT_DATA suite_list_t suites[MAX_SUITES];
+UNIT_DATA int suite_idx = 0;
+
+#ifndef MAX_LATENCIES
+#define MAX_LATENCIES 16
+#endif
+
+typedef struct {
+    const char *name;
+    int dist;
+    uint64_t ns;
+    uint64_t max;
+    uint64_t rng;
+} unit_latency_t;
+
+UNIT_DATA unit_latency_t latencies[MAX_LATENCIES];
+UNIT_DATA int latency_idx = 0;
+UNIT_DATA uint64_t latency_injected = 0;
+
+UNIT_DATA int total_errors = 0;
+UNIT_DATA int total_fail = 0;
+UNIT_DATA int total_pass = 0;
+UNIT_DATA int total_run = 0;
+UNIT_DATA int total_skipped = 0;
+UNIT_DATA int unit_in_child = 0;
+UNIT_DATA int unit_list_only = 0;
+UNIT_DATA unsigned int unit_timeout = TEST_TIMEOUT;
+UNIT_DATA long long unit_timeout_arg = -1;  // --timeout=ms
+UNIT_DATA long long unit_param_row = -1;    // the row that is running
+UNIT_DATA const char *unit_param_file = NULL;
+
+/*
+ *  The fixture of the suite and the hooks that build it and tear it down. The
+ *  setup and teardown of the tests are given to each test as it is added.
+ */
+UNIT_DATA void *unit_fixture = NULL;
+UNIT_DATA fixture_setup_t unit_fixture_setup = NULL;
+UNIT_DATA fixture_teardown_t unit_fixture_teardown = NULL;
+UNIT_DATA fptr_t unit_next_setup = NULL;
+UNIT_DATA fptr_t unit_next_teardown = NULL;
+
+/*
+ *  Test selection from the command line. Shards are numbered from 1.
+ */
+UNIT_DATA char **unit_filters = NULL;
+UNIT_DATA int unit_num_filters = 0;
+UNIT_DATA int unit_shard = 1;
+UNIT_DATA int unit_num_shards = 1;
+UNIT_DATA int unit_jobs = 1;
+UNIT_DATA const char *unit_history = NULL;
+UNIT_DATA int unit_have_history = 0;
+UNIT_DATA const char *unit_suite_filter = NULL;
+UNIT_DATA uint64_t unit_seed = 0;
+UNIT_DATA int unit_have_seed = 0;
+
+#if USE_CAPTURE == 1
+UNIT_DATA jmp_buf unit_jbuf;
+#endif
+
+#if USE_MEMORY==1
+UNIT_DATA unsigned int memory_pool = 0;
+UNIT_DATA unsigned int total_memory_allocated = 0;   // for the summary of the suite
+UNIT_DATA unsigned int test_memory_allocated = 0;    // for the test that runs
+
+UNIT_DATA int malloc_count = 0;
+UNIT_DATA int calloc_count = 0;
+UNIT_DATA int free_count = 0;
+UNIT_DATA int realloc_count = 0;
+UNIT_DATA int strdup_count = 0;
+
+UNIT_FUNC void reset_memory_stats(void) {
+    malloc_count = 0;
+    calloc_count = 0;
+    free_count = 0;
+    realloc_count = 0;
+    strdup_count = 0;
+    test_memory_allocated = 0;
+}
+
+#endif
+
+#if FILE_IO_USED==1
+UNIT_DATA int fopen_count = 0;
+UNIT_DATA int fread_count = 0;
+UNIT_DATA int fwrite_count = 0;
+UNIT_DATA int fclose_count = 0;
+UNIT_DATA int open_count = 0;
+UNIT_DATA int read_count = 0;
+UNIT_DATA int write_count = 0;
+UNIT_DATA int close_count = 0;
+UNIT_DATA int lseek_count = 0;
+UNIT_DATA int unlink_count = 0;
+UNIT_DATA int mmap_count = 0;
+UNIT_DATA int munmap_count = 0;
+UNIT_DATA uint64_t io_bytes_read = 0;
+UNIT_DATA uint64_t io_bytes_written = 0;
+UNIT_DATA int io_files_open = 0;
+
+UNIT_FUNC void reset_io_stats(void) {
+    fopen_count = 0;
+    fread_count = 0;
+    fwrite_count = 0;
+    fclose_count = 0;
+    open_count = 0;
+    read_count = 0;
+    write_count = 0;
+    close_count = 0;
+    lseek_count = 0;
+    unlink_count = 0;
+    mmap_count = 0;
+    munmap_count = 0;
+    io_bytes_read = 0;
+    io_bytes_written = 0;
+    io_files_open = 0;
+}
+
+#endif
+
+#if USE_TIME==1
+#ifndef UNIT_TIME_EPOCH
+#define UNIT_TIME_EPOCH 1000000000  // seconds, the realtime clock at 0
+#endif
+
+UNIT_DATA uint64_t unit_clock = 0;          // nanoseconds of virtual time
+UNIT_DATA uint64_t unit_clock_step = 0;     // added every time it is read
+UNIT_DATA uint64_t time_slept = 0;
+UNIT_DATA int sleep_count = 0;
+
+UNIT_FUNC void reset_virtual_clock(void) {
+    unit_clock = 0;
+    unit_clock_step = 0;
+    time_slept = 0;
+    sleep_count = 0;
+}
+
+#endif
+
+UNIT_FUNC void show_mocks_and_stubs(void) {
+
+    printf("\nMocks:\n");
+    for(int i = 0; mocks[i].name != NULL; i++)
+        printf("   %s: %d\n", mocks[i].name, mocks[i].count);
+
+    printf("Stubs:\n");
+    for(int i = 0; stubs[i].name != NULL; i++)
+        printf("   %s: %d\n", stubs[i].name, stubs[i].count);
+}
+
+UNIT_FUNC void reset_mocks_and_stubs(void) {
+
+    for(int i = 0; mocks[i].name != NULL; i++)
+        mocks[i].count = 0;
+
+    for(int i = 0; stubs[i].name != NULL; i++)
+        stubs[i].count = 0;
+
+    // a latency lasts until the end of the test that sets it
+    latency_idx = 0;
+    latency_injected = 0;
+}
+
+UNIT_FUNC void unit_print_summary(void) {
+
+    printf("\n%s: test funcs: %d, pass: %d, fail: %d, errors: %d\n",
+           suite_name, total_run, total_pass, total_fail, total_errors);
+    if(total_skipped > 0)
+        printf("     skipped: %d\n", total_skipped);
+    printf("     tests: %d, stubs: %d, mocks: %d\n", test_idx, stub_idx, mock_idx);
+
+#if USE_MEMORY==1
+    if(unit_use_memory)
+        printf("     memory allocated: %u, memory still in use: %u\n",
+               total_memory_allocated, memory_pool);
+#endif
+
+    if(unit_verbose > 3) {
+        show_mocks_and_stubs();
+    }
+}
+
+UNIT_FUNC void exit_routine(void) {
+
+    // a test that calls exit() in a forked child must not print the summary
+    if(unit_in_child || unit_list_only)
+        return;
+
+    unit_print_summary();
+}
+
+/*
+ *  Get ready to run a test suite. The settings come from the configuration
+ *  parameters of the test suite. Everything that the previous suite in the
+ *  same test runner left behind is cleared.
+ */
+UNIT_FUNC void unit_init(suite_list_t *suite) {
+
+    suite_name = suite->name;
+    unit_verbose = suite->verbose;
+    unit_isolation = suite->isolation;
+    unit_use_memory = suite->memory;
+    unit_use_vfs = suite->vfs;
+    unit_use_time = suite->time;
+    unit_timeout = unit_timeout_arg >= 0 ? (unsigned int)unit_timeout_arg : suite->timeout;
+
+    memset(tests, 0, sizeof(tests));
+    memset(mocks, 0, sizeof(mocks));
+    memset(stubs, 0, sizeof(stubs));
+    test_idx = 0;
+    mock_idx = 0;
+    stub_idx = 0;
+    unit_fixture = NULL;
+    unit_fixture_setup = NULL;
+    unit_fixture_teardown = NULL;
+    unit_next_setup = NULL;
+    unit_next_teardown = NULL;
+
+    total_errors = 0;
+    total_fail = 0;
+    total_pass = 0;
+    total_run = 0;
+    total_skipped = 0;
+    unit_have_history = 0;
+#if USE_MEMORY==1
+    total_memory_allocated = 0;
+    memory_pool = 0;
+#endif
+}
+
+/*
+ *  Report a test that was ended by a signal. This is always printed,
+ *  regardless of the verbosity setting.
+ */
+UNIT_FUNC void unit_report_signal(test_list_t *test, int sig, void *addr) {
+
+    test->fail ++;
+    if(addr != NULL)
+        unit_print(test->name, 0, "FAIL", suite_name,
+                   "caught signal %d (%s) at address %p", sig, strsignal(sig), addr);
+    else
+        unit_print(test->name, 0, "FAIL", suite_name,
+                   "caught signal %d (%s)", sig, strsignal(sig));
+}
+
+/*
+ *  In process crash recovery. The handlers run on an alternate stack so that
+ *  a stack overflow can also be reported. They jump straight back into the
+ *  test runner, which fails the test and carries on with the next one. The
+ *  state of the module under test is not restored, so a test that follows a
+ *  crash may see odd results. Use USE_ISOLATION = 2 if that matters.
+ */
+UNIT_DATA sigjmp_buf unit_sig_jbuf;
+UNIT_DATA volatile sig_atomic_t unit_sig_num = 0;
+UNIT_DATA void *volatile unit_sig_addr = NULL;
+UNIT_DATA char unit_sig_stack[1024*64];
+
+UNIT_FUNC void unit_signal_handler(int sig, siginfo_t *info, void *ctx) {
+
+    (void)ctx;
+    unit_sig_num = sig;
+    unit_sig_addr = info->si_addr;
+    siglongjmp(unit_sig_jbuf, 1);
+}
+
+UNIT_FUNC void unit_install_handlers(void) {
+
+    stack_t ss;
+    struct sigaction sa;
+
+    ss.ss_sp = unit_sig_stack;
+    ss.ss_size = sizeof(unit_sig_stack);
+    ss.ss_flags = 0;
+    if(sigaltstack(&ss, NULL) != 0)
+        unit_error("cannot install the alternate signal stack");
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = unit_signal_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+    sigaction(SIGFPE, &sa, NULL);
+}
+
+/******************************************************************************
+ *  Function profiler. Code that is compiled with -finstrument-functions calls
+ *  back into the driver when it enters and leaves every function. Each thread
+ *  keeps a shadow stack of the functions that it is in, with the time stamp
+ *  counter when each one was entered, and a tree of the distinct call stacks
+ *  that it has seen, so that a call only costs two reads of the counter and a
+ *  lookup of the node for the function under its caller. The time of a call
+ *  goes to its node, and the part that was not spent in its callees is its
+ *  exclusive time. Profiling is off unless --profile is given, and the hooks
+ *  return at once then.
+ *
+ *  A longjmp() or a crash leaves frames on the shadow stack, so a function
+ *  that returns closes every frame above its own. The callbacks, and anything
+ *  they call, must not be instrumented themselves.
+ */
+#define UNIT_NO_PROFILE __attribute__((no_instrument_function))
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define unit_ticks() __rdtsc()
+#else
+#define unit_ticks() unit_prof_clock()
+#endif
+
+typedef struct {
+    void *fn;
+    int parent;         // node of the caller, -1 for a function called by the driver
+    int func;           // in the report
+    uint64_t calls;
+    uint64_t incl;      // in ticks
+    uint64_t excl;
+} unit_prof_node_t;
+
+typedef struct {
+    void *fn;
+    int node;
+    uint64_t start;
+    uint64_t child;     // ticks spent in the callees
+} unit_prof_frame_t;
+
+typedef struct {
+    unit_prof_node_t nodes[MAX_PROF_NODES];
+    int num_nodes;
+    int slots[2*MAX_PROF_NODES];    // hash of (parent, fn) to node+1
+    unit_prof_frame_t stack[MAX_PROF_DEPTH];
+    int depth;
+    int over;           // calls deeper than the stack can hold
+    uint64_t lost;      // calls that did not fit in the tree
+} unit_prof_thread_t;
+
+typedef struct {
+    void *fn;
+    uint64_t calls;
+    uint64_t incl;
+    uint64_t excl;
+    char name[128];
+} unit_prof_func_t;
+
+UNIT_DATA const char *unit_prof_file = NULL;    // --profile=file
+UNIT_DATA volatile int unit_prof_on = 0;
+UNIT_DATA unit_prof_thread_t *unit_prof_threads = NULL;   // MAX_PROF_THREADS of them
+UNIT_DATA unit_prof_func_t *unit_prof_funcs = NULL;       // MAX_PROF_NODES of them
+UNIT_DATA int unit_prof_num_threads = 0;
+UNIT_DATA __thread unit_prof_thread_t *unit_prof_self = NULL;
+UNIT_DATA __thread int unit_prof_no_slot = 0;
+UNIT_DATA uint64_t unit_prof_ticks0 = 0;
+UNIT_DATA uint64_t unit_prof_ns0 = 0;
+
+UNIT_FUNC UNIT_NO_PROFILE uint64_t unit_prof_clock(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+UNIT_FUNC UNIT_NO_PROFILE unit_prof_thread_t *unit_prof_claim(void) {
+
+    int idx;
+
+    if(unit_prof_no_slot)
+        return NULL;
+    idx = __atomic_fetch_add(&unit_prof_num_threads, 1, __ATOMIC_RELAXED);
+    if(idx >= MAX_PROF_THREADS) {
+        unit_prof_no_slot = 1;
+        return NULL;
+    }
+    unit_prof_self = &unit_prof_threads[idx];
+    return unit_prof_self;
+}
+
+/*
+ *  Find the node of a function under its caller, or make one. Returns -1 when
+ *  the tree is full.
+ */
+UNIT_FUNC UNIT_NO_PROFILE int unit_prof_node(unit_prof_thread_t *self, int parent, void *fn) {
+
+    uint32_t mask = 2*MAX_PROF_NODES - 1;
+    uint32_t h = (uint32_t)((((uintptr_t)fn >> 4) ^ ((uint64_t)(parent + 1) << 20)) *
+                            0x9e3779b97f4a7c15ull >> 32) & mask;
+
+    for(;;) {
+        int k = self->slots[h];
+        if(k == 0)
+            break;
+        if(self->nodes[k-1].fn == fn && self->nodes[k-1].parent == parent)
+            return k-1;
+        h = (h + 1) & mask;
+    }
+
+    if(self->num_nodes >= MAX_PROF_NODES)
+        return -1;
+    unit_prof_node_t *node = &self->nodes[self->num_nodes];
+    node->fn = fn;
+    node->parent = parent;
+    self->slots[h] = ++self->num_nodes;
+    return self->num_nodes - 1;
+}
+
+UNIT_NO_PROFILE __attribute__((weak)) void __cyg_profile_func_enter(void *fn, void *caller) {
+
+    unit_prof_thread_t *self = unit_prof_self;
+
+    (void)caller;
+    if(!unit_prof_on)
+        return;
+    if(self == NULL && (self = unit_prof_claim()) == NULL)
+        return;
+    if(self->over > 0 || self->depth >= MAX_PROF_DEPTH) {
+        self->over ++;
+        return;
+    }
+
+    int parent = (self->depth > 0) ? self->stack[self->depth-1].node : -1;
+    unit_prof_frame_t *frame = &self->stack[self->depth++];
+    frame->fn = fn;
+    frame->node = unit_prof_node(self, parent, fn);
+    frame->child = 0;
+    frame->start = unit_ticks();
+}
+
+UNIT_NO_PROFILE __attribute__((weak)) void __cyg_profile_func_exit(void *fn, void *caller) {
+
+    uint64_t now = unit_ticks();
+    unit_prof_thread_t *self = unit_prof_self;
+    int depth;
+
+    (void)caller;
+    if(!unit_prof_on || self == NULL)
+        return;
+    if(self->over > 0) {
+        self->over --;
+        return;
+    }
+
+    // a function that was entered before the profiler started has no frame
+    for(depth = self->depth; depth > 0 && self->stack[depth-1].fn != fn; depth--)
+        ;
+
+    while(depth > 0 && self->depth >= depth) {
+        unit_prof_frame_t *frame = &self->stack[--self->depth];
+        uint64_t elapsed = now - frame->start;
+
+        if(frame->node >= 0) {
+            unit_prof_node_t *node = &self->nodes[frame->node];
+            node->calls ++;
+            node->incl += elapsed;
+            node->excl += elapsed - frame->child;
+        }
+        else
+            self->lost ++;
+        if(self->depth > 0)
+            self->stack[self->depth-1].child += elapsed;
+    }
+}
+
+/*
+ *  Drop the frames that a test left behind when it crashed or jumped out, so
+ *  that the next test does not run under them.
+ */
+UNIT_FUNC void unit_prof_unwind(void) {
+
+    if(unit_prof_self != NULL) {
+        unit_prof_self->depth = 0;
+        unit_prof_self->over = 0;
+    }
+}
+
+/*
+ *  The tables of the profiler take megabytes, so they are only mapped when a
+ *  profile is asked for. The pages of the threads that never call in are not
+ *  touched, so they take no memory.
+ */
+UNIT_FUNC int unit_prof_alloc(void) {
+
+    size_t threads = MAX_PROF_THREADS * sizeof(unit_prof_thread_t);
+    size_t funcs = MAX_PROF_NODES * sizeof(unit_prof_func_t);
+
+    if(unit_prof_threads != NULL)
+        return 0;
+    char *map = mmap(NULL, threads + funcs, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(map == MAP_FAILED)
+        return -1;
+    unit_prof_funcs = (unit_prof_func_t*)(map + threads);
+    unit_prof_threads = (unit_prof_thread_t*)map;
+    return 0;
+}
+
+/*
+ *  Clear the profile and start over. Threads keep the slot that they have.
+ */
+UNIT_FUNC void unit_prof_start(void) {
+
+    int count = unit_prof_num_threads;
+
+    if(unit_prof_alloc() != 0) {
+        unit_error("cannot allocate the profile: %s", strerror(errno));
+        return;
+    }
+    if(count > MAX_PROF_THREADS)
+        count = MAX_PROF_THREADS;
+    for(int t = 0; t < count; t++) {
+        unit_prof_thread_t *thread = &unit_prof_threads[t];
+        thread->num_nodes = 0;
+        thread->depth = 0;
+        thread->over = 0;
+        thread->lost = 0;
+        memset(thread->slots, 0, sizeof(thread->slots));
+        memset(thread->nodes, 0, sizeof(thread->nodes));
+    }
+    unit_prof_ticks0 = unit_ticks();
+    unit_prof_ns0 = unit_prof_clock();
+    unit_prof_on = 1;
+}
+
+/*
+ *  Find the name of a function from the symbol table of the file that it is
+ *  in, since a static function has no dynamic symbol. The last file that was
+ *  read is kept mapped.
+ */
+#ifndef ELF_ST_TYPE
+#if __ELF_NATIVE_CLASS == 64
+#define ELF_ST_TYPE(info) ELF64_ST_TYPE(info)
+#else
+#define ELF_ST_TYPE(info) ELF32_ST_TYPE(info)
+#endif
+#endif
+
+typedef struct {
+    char path[PATH_MAX];
+    const char *map;
+    size_t size;
+    const ElfW(Sym) *syms;
+    size_t num_syms;
+    const char *strs;
+    int pie;
+} unit_elf_t;
+
+UNIT_DATA unit_elf_t unit_prof_elf;
+
+UNIT_FUNC void unit_prof_load_elf(unit_elf_t *elf, const char *path) {
+
+    struct stat st;
+    int fd;
+
+    if(elf->map != NULL)
+        munmap((void*)elf->map, elf->size);
+    memset(elf, 0, sizeof(*elf));
+    snprintf(elf->path, sizeof(elf->path), "%s", path);
+
+    // the main program may be named relative to a directory that was left
+    if((fd = open(path, O_RDONLY)) < 0 && (fd = open("/proc/self/exe", O_RDONLY)) < 0)
+        return;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ElfW(Ehdr)) ||
+            (elf->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        elf->map = NULL;
+        close(fd);
+        return;
+    }
+    close(fd);
+    elf->size = st.st_size;
+
+    const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr)*)elf->map;
+    if(memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+            ehdr->e_shoff + (size_t)ehdr->e_shnum * sizeof(ElfW(Shdr)) > elf->size)
+        return;
+    elf->pie = (ehdr->e_type == ET_DYN);
+
+    const ElfW(Shdr) *shdr = (const ElfW(Shdr)*)(elf->map + ehdr->e_shoff);
+    for(int pass = 0; pass < 2 && elf->syms == NULL; pass++)
+        for(int i = 0; i < ehdr->e_shnum; i++) {
+            if(shdr[i].sh_type != ((pass == 0) ? SHT_SYMTAB : SHT_DYNSYM) ||
+                    shdr[i].sh_link >= ehdr->e_shnum ||
+                    shdr[i].sh_offset + shdr[i].sh_size > elf->size)
+                continue;
+            elf->syms = (const ElfW(Sym)*)(elf->map + shdr[i].sh_offset);
+            elf->num_syms = shdr[i].sh_size / sizeof(ElfW(Sym));
+            elf->strs = elf->map + shdr[shdr[i].sh_link].sh_offset;
+            break;
+        }
+}
+
+UNIT_FUNC const char *unit_prof_name(void *fn, char *buf, size_t size) {
+
+    Dl_info info;
+
+    snprintf(buf, size, "%p", fn);
+    if(dladdr(fn, &info) == 0 || info.dli_fname == NULL)
+        return buf;
+
+    unit_elf_t *elf = &unit_prof_elf;
+    if(strcmp(elf->path, info.dli_fname) != 0)
+        unit_prof_load_elf(elf, info.dli_fname);
+
+    uintptr_t addr = (uintptr_t)fn - (elf->pie ? (uintptr_t)info.dli_fbase : 0);
+    for(size_t i = 0; i < elf->num_syms; i++) {
+        const ElfW(Sym) *sym = &elf->syms[i];
+        if(ELF_ST_TYPE(sym->st_info) == STT_FUNC && sym->st_value == addr) {
+            snprintf(buf, size, "%s", elf->strs + sym->st_name);
+            return buf;
+        }
+    }
+    if(info.dli_sname != NULL && info.dli_saddr == fn)
+        snprintf(buf, size, "%s", info.dli_sname);
+    return buf;
+}
+
+UNIT_FUNC int unit_prof_compare(const void *a, const void *b) {
+
+    const unit_prof_func_t *fa = (const unit_prof_func_t*)a;
+    const unit_prof_func_t *fb = (const unit_prof_func_t*)b;
+
+    return (fa->excl < fb->excl) - (fa->excl > fb->excl);
+}
+
+/*
+ *  Write the folded stacks, one line for every call stack with the functions
+ *  from the outside in, separated by ';', and its exclusive time in ns. This
+ *  is the input of flamegraph.pl and the like. A line is written in one go,
+ *  so that forked tests can append to the same file.
+ */
+UNIT_FUNC void unit_prof_write(const unit_prof_func_t *funcs, double ns_per_tick) {
+
+    char line[4096];
+    int fd;
+
+    if((fd = open(unit_prof_file, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+        unit_error("cannot write the profile to \"%s\": %s", unit_prof_file, strerror(errno));
+        return;
+    }
+
+    int count = (unit_prof_num_threads < MAX_PROF_THREADS) ? unit_prof_num_threads : MAX_PROF_THREADS;
+    for(int t = 0; t < count; t++) {
+        unit_prof_thread_t *thread = &unit_prof_threads[t];
+        for(int n = 0; n < thread->num_nodes; n++) {
+            int path[MAX_PROF_DEPTH];
+            int depth = 0;
+            size_t len = 0;
+            uint64_t ns = (uint64_t)(thread->nodes[n].excl * ns_per_tick);
+
+            if(ns == 0)
+                continue;
+            for(int k = n; k >= 0 && depth < MAX_PROF_DEPTH; k = thread->nodes[k].parent)
+                path[depth++] = k;
+
+            // room is left at the end for the time
+            while(depth-- > 0 && len < sizeof(line) - 64) {
+                unit_prof_node_t *node = &thread->nodes[path[depth]];
+                if(node->func >= 0)
+                    len += snprintf(&line[len], sizeof(line) - 64 - len, "%s", funcs[node->func].name);
+                else
+                    len += snprintf(&line[len], sizeof(line) - 64 - len, "%p", node->fn);
+                if(depth > 0 && len < sizeof(line) - 64)
+                    line[len++] = ';';
+            }
+            if(len > sizeof(line) - 64)
+                len = sizeof(line) - 64;
+            len += snprintf(&line[len], 64, " %llu\n", (unsigned long long)ns);
+            if(write(fd, line, len) != (ssize_t)len)
+                break;
+        }
+    }
+    close(fd);
+}
+
+/*
+ *  Stop profiling, add up the time of every function and write the folded
+ *  stacks. When printing, report the functions that took the most time. The
+ *  inclusive time of a recursive function only counts its outermost calls.
+ */
+UNIT_FUNC void unit_prof_report(int print) {
+
+    unit_prof_func_t *funcs = unit_prof_funcs;
+    int num_funcs = 0;
+    uint64_t lost = 0;
+
+    unit_prof_on = 0;
+    if(unit_prof_threads == NULL)
+        return;
+    uint64_t ticks = unit_ticks() - unit_prof_ticks0;
+    uint64_t ns = unit_prof_clock() - unit_prof_ns0;
+    double ns_per_tick = (ticks > 0) ? (double)ns / ticks : 1.0;
+
+    int count = (unit_prof_num_threads < MAX_PROF_THREADS) ? unit_prof_num_threads : MAX_PROF_THREADS;
+    for(int t = 0; t < count; t++) {
+        unit_prof_thread_t *thread = &unit_prof_threads[t];
+        lost += thread->lost;
+        for(int n = 0; n < thread->num_nodes; n++) {
+            unit_prof_node_t *node = &thread->nodes[n];
+            int f;
+            for(f = 0; f < num_funcs && funcs[f].fn != node->fn; f++)
+                ;
+            node->func = -1;
+            if(f == num_funcs) {
+                if(num_funcs >= MAX_PROF_NODES)
+                    continue;
+                memset(&funcs[f], 0, sizeof(funcs[f]));
+                funcs[f].fn = node->fn;
+                unit_prof_name(node->fn, funcs[f].name, sizeof(funcs[f].name));
+                num_funcs ++;
+            }
+            node->func = f;
+            funcs[f].calls += node->calls;
+            funcs[f].excl += node->excl;
+
+            int outer = 1;
+            for(int k = node->parent; k >= 0; k = thread->nodes[k].parent)
+                if(thread->nodes[k].fn == node->fn)
+                    outer = 0;
+            if(outer)
+                funcs[f].incl += node->incl;
+        }
+    }
+
+    unit_prof_write(funcs, ns_per_tick);
+    if(!print)
+        return;
+
+    if(num_funcs == 0) {
+        if(unit_jobs > 1 || unit_isolation == 2)
+            printf("\nprofile of %s: the forked tests wrote their stacks to %s\n",
+                   suite_name, unit_prof_file);
+        else
+            printf("\nprofile of %s: no calls, build the code with -finstrument-functions\n",
+                   suite_name);
+        return;
+    }
+
+    qsort(funcs, num_funcs, sizeof(funcs[0]), unit_prof_compare);
+    printf("\nprofile of %s, %d functions in %d threads, written to %s:\n",
+           suite_name, num_funcs, count, unit_prof_file);
+    printf("  %14s %14s %12s  %s\n", "inclusive ns", "exclusive ns", "calls", "function");
+    for(int f = 0; f < num_funcs && f < 20; f++)
+        printf("  %14llu %14llu %12llu  %s\n",
+               (unsigned long long)(funcs[f].incl * ns_per_tick),
+               (unsigned long long)(funcs[f].excl * ns_per_tick),
+               (unsigned long long)funcs[f].calls, funcs[f].name);
+    if(lost > 0)
+        printf("  %llu calls were not profiled, increase MAX_PROF_NODES (%d)\n",
+               (unsigned long long)lost, MAX_PROF_NODES);
+}
+
+/******************************************************************************
+ *  Filesystem in memory. When USE_VFS is set, the file IO replacement functions
+ *  do not touch the disk. Every path that the code under test opens is a file
+ *  in memory, and every test starts with an empty filesystem of its own, so
+ *  tests that use the same paths cannot collide, even when they run at the
+ *  same time. The contents of a file are kept in an anonymous mapping that is
+ *  grown with mremap(), so a large file is not copied as it grows.
+ *
+ *  A file has a descriptor above UNIT_VFS_FD_BASE, so a descriptor that is
+ *  not in memory, such as stdout, is passed on to the C library.
+ *  A stream is made with fopencookie() on top of a descriptor, so stdio does
+ *  its own buffering as it does for a real file.
+ *
+ *  mmap() of a file is emulated with an anonymous mapping that is filled with
+ *  the contents of the file. A shared mapping that can be written is written
+ *  back to the file by munmap(). What is written to the file while it is
+ *  mapped is not seen in the mapping.
+ *
+ *  Faults are injected by the test. Reads and writes can be cut short, and
+ *  the filesystem can be given a size, past which a write fails with ENOSPC
+ *  once it cannot write anything at all.
+ */
+#if FILE_IO_USED==1
+
+#ifndef MAX_VFS_FILES
+#define MAX_VFS_FILES 64
+#endif
+
+#ifndef MAX_VFS_FDS
+#define MAX_VFS_FDS 64
+#endif
+
+#define UNIT_VFS_FD_BASE    (1 << 24)
+#define UNIT_VFS_NAME       256
+
+typedef struct {
+    char name[UNIT_VFS_NAME];   // empty when the file has been unlinked
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+    int refs;                   // descriptors and mappings of the file
+    int used;
+} unit_vfs_file_t;
+
+typedef struct {
+    int file;                   // -1 when the descriptor is free
+    int flags;
+    size_t pos;
+} unit_vfs_fd_t;
+
+typedef struct {
+    void *addr;
+    size_t len;
+    int file;
+    size_t off;
+    int write_back;
+} unit_vfs_map_t;
+
+UNIT_DATA unit_vfs_file_t unit_vfs_files[MAX_VFS_FILES];
+UNIT_DATA unit_vfs_fd_t unit_vfs_fds[MAX_VFS_FDS];
+UNIT_DATA unit_vfs_map_t unit_vfs_maps[MAX_VFS_FDS];
+UNIT_DATA size_t unit_vfs_used = 0;             // bytes in all files
+UNIT_DATA size_t unit_vfs_space = 0;            // 0 for no limit
+UNIT_DATA size_t unit_vfs_short_read = 0;       // 0 for whole reads
+UNIT_DATA size_t unit_vfs_short_write = 0;
+
+UNIT_FUNC void unit_vfs_release(int f) {
+
+    unit_vfs_file_t *file = &unit_vfs_files[f];
+
+    if(file->refs > 0 || file->name[0] != '\0')
+        return;
+    if(file->data != NULL)
+        munmap(file->data, file->cap);
+    unit_vfs_used -= file->size;
+    memset(file, 0, sizeof(*file));
+}
+
+UNIT_FUNC void unit_vfs_reset(void) {
+
+    for(int m = 0; m < MAX_VFS_FDS; m++)
+        if(unit_vfs_maps[m].addr != NULL)
+            munmap(unit_vfs_maps[m].addr, unit_vfs_maps[m].len);
+    for(int f = 0; f < MAX_VFS_FILES; f++)
+        if(unit_vfs_files[f].data != NULL)
+            munmap(unit_vfs_files[f].data, unit_vfs_files[f].cap);
+
+    memset(unit_vfs_files, 0, sizeof(unit_vfs_files));
+    memset(unit_vfs_maps, 0, sizeof(unit_vfs_maps));
+    for(int d = 0; d < MAX_VFS_FDS; d++)
+        unit_vfs_fds[d].file = -1;
+    unit_vfs_used = 0;
+    unit_vfs_space = 0;
+    unit_vfs_short_read = 0;
+    unit_vfs_short_write = 0;
+}
+
+UNIT_FUNC int unit_vfs_find(const char *path) {
+
+    for(int f = 0; f < MAX_VFS_FILES; f++)
+        if(unit_vfs_files[f].used && !strcmp(unit_vfs_files[f].name, path))
+            return f;
+    return -1;
+}
+
+UNIT_FUNC void unit_vfs_faults(size_t short_read, size_t short_write, size_t space) {
+
+    if(short_read != (size_t)-1)
+        unit_vfs_short_read = short_read;
+    if(short_write != (size_t)-1)
+        unit_vfs_short_write = short_write;
+    if(space != (size_t)-1)
+        unit_vfs_space = space;
+}
+
+UNIT_FUNC unit_vfs_fd_t *unit_vfs_fd(int fd) {
+
+    if(!unit_use_vfs || fd < UNIT_VFS_FD_BASE || fd >= UNIT_VFS_FD_BASE + MAX_VFS_FDS)
+        return NULL;
+    unit_vfs_fd_t *vfd = &unit_vfs_fds[fd - UNIT_VFS_FD_BASE];
+    return (vfd->file >= 0) ? vfd : NULL;
+}
+
+/*
+ *  Make room for a file of the given size, which is zero filled past its end.
+ */
+UNIT_FUNC int unit_vfs_grow(unit_vfs_file_t *file, size_t size) {
+
+    if(size > file->cap) {
+        size_t cap = (file->cap > 0) ? file->cap : 4096;
+        while(cap < size)
+            cap *= 2;
+        void *data = (file->data == NULL)
+            ? mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+            : mremap(file->data, file->cap, cap, MREMAP_MAYMOVE);
+        if(data == MAP_FAILED) {
+            errno = ENOMEM;
+            return -1;
+        }
+        file->data = data;
+        file->cap = cap;
+    }
+    if(size > file->size) {
+        unit_vfs_used += size - file->size;
+        file->size = size;
+    }
+    return 0;
+}
+
+UNIT_FUNC void unit_vfs_truncate(unit_vfs_file_t *file) {
+
+    unit_vfs_used -= file->size;
+    if(file->data != NULL)
+        memset(file->data, 0, file->size);
+    file->size = 0;
+}
+
+UNIT_FUNC int unit_vfs_open(const char *path, int flags) {
+
+    int f = unit_vfs_find(path);
+    int d;
+
+    if(strlen(path) >= UNIT_VFS_NAME) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if(f >= 0 && (flags & O_CREAT) && (flags & O_EXCL)) {
+        errno = EEXIST;
+        return -1;
+    }
+    for(d = 0; d < MAX_VFS_FDS && unit_vfs_fds[d].file >= 0; d++)
+        ;
+    if(d == MAX_VFS_FDS) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    if(f < 0) {
+        if(!(flags & O_CREAT)) {
+            errno = ENOENT;
+            return -1;
+        }
+        for(f = 0; f < MAX_VFS_FILES && unit_vfs_files[f].used; f++)
+            ;
+        if(f == MAX_VFS_FILES) {
+            errno = ENFILE;
+            return -1;
+        }
+        unit_vfs_files[f].used = 1;
+        strcpy(unit_vfs_files[f].name, path);
+    }
+    else if((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY)
+        unit_vfs_truncate(&unit_vfs_files[f]);
+
+    unit_vfs_files[f].refs ++;
+    unit_vfs_fds[d].file = f;
+    unit_vfs_fds[d].flags = flags;
+    unit_vfs_fds[d].pos = 0;
+    return UNIT_VFS_FD_BASE + d;
+}
+
+UNIT_FUNC ssize_t unit_vfs_read(unit_vfs_fd_t *vfd, void *buf, size_t count) {
+
+    unit_vfs_file_t *file = &unit_vfs_files[vfd->file];
+
+    if((vfd->flags & O_ACCMODE) == O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    if(unit_vfs_short_read > 0 && count > unit_vfs_short_read)
+        count = unit_vfs_short_read;
+    if(vfd->pos >= file->size)
+        return 0;
+    if(count > file->size - vfd->pos)
+        count = file->size - vfd->pos;
+
+    memcpy(buf, &file->data[vfd->pos], count);
+    vfd->pos += count;
+    return (ssize_t)count;
+}
+
+UNIT_FUNC ssize_t unit_vfs_write(unit_vfs_fd_t *vfd, const void *buf, size_t count) {
+
+    unit_vfs_file_t *file = &unit_vfs_files[vfd->file];
+
+    if((vfd->flags & O_ACCMODE) == O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    if(vfd->flags & O_APPEND)
+        vfd->pos = file->size;
+    if(unit_vfs_short_write > 0 && count > unit_vfs_short_write)
+        count = unit_vfs_short_write;
+
+    // only what makes the file larger takes space
+    if(unit_vfs_space > 0 && vfd->pos + count > file->size) {
+        size_t room = (unit_vfs_space > unit_vfs_used) ? unit_vfs_space - unit_vfs_used : 0;
+        if(vfd->pos + count > file->size + room)
+            count = (file->size + room > vfd->pos) ? file->size + room - vfd->pos : 0;
+        if(count == 0) {
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+
+    if(unit_vfs_grow(file, vfd->pos + count) != 0)
+        return -1;
+    memcpy(&file->data[vfd->pos], buf, count);
+    vfd->pos += count;
+    return (ssize_t)count;
+}
+
+UNIT_FUNC off_t unit_vfs_lseek(unit_vfs_fd_t *vfd, off_t off, int whence) {
+
+    off_t base = 0;
+
+    if(whence == SEEK_CUR)
+        base = (off_t)vfd->pos;
+    else if(whence == SEEK_END)
+        base = (off_t)unit_vfs_files[vfd->file].size;
+    else if(whence != SEEK_SET) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(base + off < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    vfd->pos = (size_t)(base + off);
+    return base + off;
+}
+
+UNIT_FUNC int unit_vfs_close(unit_vfs_fd_t *vfd) {
+
+    int f = vfd->file;
+
+    vfd->file = -1;
+    unit_vfs_files[f].refs --;
+    unit_vfs_release(f);
+    return 0;
+}
+
+/*
+ *  An unlinked file lives on until its last descriptor or mapping is gone.
+ */
+UNIT_FUNC int unit_vfs_unlink(const char *path) {
+
+    int f = unit_vfs_find(path);
+
+    if(f < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    unit_vfs_files[f].name[0] = '\0';
+    unit_vfs_release(f);
+    return 0;
+}
+
+/*
+ *  A stream in the filesystem in memory is a cookie stream over a descriptor.
+ */
+UNIT_FUNC ssize_t unit_vfs_cookie_read(void *cookie, char *buf, size_t size) {
+
+    unit_vfs_fd_t *vfd = unit_vfs_fd((int)(intptr_t)cookie);
+    return (vfd != NULL) ? unit_vfs_read(vfd, buf, size) : -1;
+}
+
+UNIT_FUNC ssize_t unit_vfs_cookie_write(void *cookie, const char *buf, size_t size) {
+
+    unit_vfs_fd_t *vfd = unit_vfs_fd((int)(intptr_t)cookie);
+    ssize_t n = (vfd != NULL) ? unit_vfs_write(vfd, buf, size) : -1;
+
+    // stdio takes 0 for an error, and tries again after a short write
+    return (n < 0) ? 0 : n;
+}
+
+UNIT_FUNC int unit_vfs_cookie_seek(void *cookie, off64_t *off, int whence) {
+
+    unit_vfs_fd_t *vfd = unit_vfs_fd((int)(intptr_t)cookie);
+    off_t pos = (vfd != NULL) ? unit_vfs_lseek(vfd, (off_t)*off, whence) : -1;
+
+    if(pos < 0)
+        return -1;
+    *off = pos;
+    return 0;
+}
+
+UNIT_FUNC int unit_vfs_cookie_close(void *cookie) {
+
+    unit_vfs_fd_t *vfd = unit_vfs_fd((int)(intptr_t)cookie);
+    return (vfd != NULL) ? unit_vfs_close(vfd) : -1;
+}
+
+UNIT_FUNC FILE *unit_vfs_fopen(const char *path, const char *mode) {
+
+    int flags;
+    cookie_io_functions_t io = {
+        .read = unit_vfs_cookie_read,
+        .write = unit_vfs_cookie_write,
+        .seek = unit_vfs_cookie_seek,
+        .close = unit_vfs_cookie_close,
+    };
+
+    switch(mode[0]) {
+        case 'r': flags = 0; break;
+        case 'w': flags = O_CREAT | O_TRUNC; break;
+        case 'a': flags = O_CREAT | O_APPEND; break;
+        default:
+            errno = EINVAL;
+            return NULL;
+    }
+    if(strchr(mode, '+') != NULL)
+        flags |= O_RDWR;
+    else
+        flags |= (mode[0] == 'r') ? O_RDONLY : O_WRONLY;
+    if(strchr(mode, 'x') != NULL)
+        flags |= O_EXCL;
+
+    int fd = unit_vfs_open(path, flags);
+    if(fd < 0)
+        return NULL;
+
+    FILE *fp = fopencookie((void*)(intptr_t)fd, mode, io);
+    if(fp == NULL)
+        unit_vfs_close(unit_vfs_fd(fd));
+    return fp;
+}
+
+UNIT_FUNC void *unit_vfs_mmap(void *addr, size_t len, int prot, int flags,
+                              unit_vfs_fd_t *vfd, off_t off) {
+
+    unit_vfs_file_t *file = &unit_vfs_files[vfd->file];
+    int m;
+
+    for(m = 0; m < MAX_VFS_FDS && unit_vfs_maps[m].addr != NULL; m++)
+        ;
+    if(m == MAX_VFS_FDS || len == 0 || off < 0) {
+        errno = (m == MAX_VFS_FDS) ? ENOMEM : EINVAL;
+        return MAP_FAILED;
+    }
+
+    void *ptr = mmap(addr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | (flags & MAP_FIXED), -1, 0);
+    if(ptr == MAP_FAILED)
+        return MAP_FAILED;
+    if((size_t)off < file->size)
+        memcpy(ptr, &file->data[off], (file->size - off < len) ? file->size - off : len);
+    mprotect(ptr, len, prot);
+
+    unit_vfs_maps[m].addr = ptr;
+    unit_vfs_maps[m].len = len;
+    unit_vfs_maps[m].file = vfd->file;
+    unit_vfs_maps[m].off = (size_t)off;
+    unit_vfs_maps[m].write_back = (flags & MAP_SHARED) && (prot & PROT_WRITE);
+    file->refs ++;
+    return ptr;
+}
+
+/*
+ *  Unmap an emulated mapping, after writing a shared one back to the file.
+ *  Returns 1 when the address was not mapped by the filesystem in memory.
+ */
+UNIT_FUNC int unit_vfs_munmap(void *addr) {
+
+    for(int m = 0; m < MAX_VFS_FDS; m++) {
+        unit_vfs_map_t *map = &unit_vfs_maps[m];
+        if(map->addr != addr)
+            continue;
+
+        unit_vfs_file_t *file = &unit_vfs_files[map->file];
+        if(map->write_back && map->off < file->size) {
+            size_t len = (file->size - map->off < map->len) ? file->size - map->off : map->len;
+            mprotect(map->addr, map->len, PROT_READ);
+            memcpy(&file->data[map->off], map->addr, len);
+        }
+        munmap(map->addr, map->len);
+        map->addr = NULL;
+        file->refs --;
+        unit_vfs_release(map->file);
+        return 0;
+    }
+    return 1;
+}
+
+UNIT_FUNC const void *unit_vfs_data(const char *path, size_t *size) {
+
+    int f = unit_vfs_find(path);
+
+    if(f < 0) {
+        *size = 0;
+        return NULL;
+    }
+    *size = unit_vfs_files[f].size;
+    return (unit_vfs_files[f].data != NULL) ? unit_vfs_files[f].data : (const void*)"";
+}
+
+#endif /* FILE_IO_USED */
+
+/******************************************************************************
+ *  Fixtures. The suite setup and teardown run outside of any test, so the
+ *  memory statistics are put back the way they were after them. Otherwise the
+ *  fixture would be counted as memory that the first test allocated, or that
+ *  the last one freed.
+ */
+UNIT_FUNC void unit_call_fixture(int setup) {
+
+#if USE_MEMORY == 1
+    unsigned int pool = memory_pool;
+    unsigned int allocated = total_memory_allocated;
+#endif
+
+    if(setup && unit_fixture_setup != NULL)
+        unit_fixture = (*unit_fixture_setup)();
+    else if(!setup && unit_fixture_teardown != NULL)
+        (*unit_fixture_teardown)(unit_fixture);
+
+#if USE_MEMORY == 1
+    memory_pool = pool;
+    total_memory_allocated = allocated;
+    reset_memory_stats();
+#endif
+}
+
+UNIT_FUNC void *unit_mutable_fixture(test_list_t *test) {
+
+    if(!unit_in_child) {
+        test->fail ++;
+        unit_print(test->name, 0, "FAIL", suite_name,
+                   "only a forked test can change the fixture, see SET_SNAPSHOT()");
+        return NULL;
+    }
+    return unit_fixture;
+}
+
+UNIT_FUNC void unit_call_test(test_list_t *test) {
+
+    if(test->setup != NULL)
+        (*test->setup)(test);
+    (*test->fptr)(test);
+    if(test->teardown != NULL)
+        (*test->teardown)(test);
+}
+
+/******************************************************************************
+ *  Timeouts. A test that runs longer than its timeout fails, so that a test
+ *  that hangs does not hold up the rest of the suite. A POSIX timer sends a
+ *  signal to the thread that runs the test when the time is up. In process,
+ *  it is SIGALRM, and its handler jumps back to the runner the same way as a
+ *  crash does, from the middle of a row or a case. A forked test has a timer
+ *  that sends SIGKILL instead, as the child can be in any state, and the
+ *  runner reports the timeout when the child was killed after its time was
+ *  up. Timers are not kept over a fork(), so the child makes its own.
+ */
+UNIT_DATA sigjmp_buf unit_timeout_jbuf;
+UNIT_DATA timer_t unit_timer;
+UNIT_DATA int unit_timer_sig = 0;          // the signal of the timer, 0 for no timer
+
+UNIT_FUNC void unit_timeout_handler(int sig) {
+
+    (void)sig;
+    siglongjmp(unit_timeout_jbuf, 1);
+}
+
+/*
+ *  Start the timer with the signal, or stop it when ms is 0.
+ */
+UNIT_FUNC void unit_arm_timer(int sig, unsigned int ms) {
+
+    struct itimerspec its;
+
+    if(ms == 0 && unit_timer_sig == 0)
+        return;
+
+    if(ms > 0 && unit_timer_sig != sig) {
+        struct sigevent sev;
+
+        if(unit_timer_sig != 0)
+            timer_delete(unit_timer);
+        unit_timer_sig = 0;
+
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_signo = sig;
+#ifdef SIGEV_THREAD_ID
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev._sigev_un._tid = gettid();
+#else
+        sev.sigev_notify = SIGEV_SIGNAL;
+#endif
+        if(timer_create(CLOCK_MONOTONIC, &sev, &unit_timer) != 0) {
+            unit_error("cannot make the timer for timeouts: %s", strerror(errno));
+            return;
+        }
+        unit_timer_sig = sig;
+
+        if(sig == SIGALRM) {
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = unit_timeout_handler;
+            sa.sa_flags = SA_ONSTACK;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGALRM, &sa, NULL);
+        }
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (long)(ms % 1000) * 1000000;
+    timer_settime(unit_timer, 0, &its, NULL);
+}
+
+UNIT_FUNC unsigned int unit_test_timeout(test_list_t *test) {
+
+    return test->timeout > 0 ? test->timeout : unit_timeout;
+}
+
+/*
+ *  Report a test that ran out of time. This is always printed, regardless of
+ *  the verbosity setting. The row that was running is named in the report,
+ *  then forgotten, as the jump skipped the code that forgets it.
+ */
+UNIT_FUNC void unit_report_timeout(test_list_t *test, unsigned int ms) {
+
+    test->fail ++;
+    unit_print(test->name, 0, "FAIL", suite_name, "timed out after %u ms", ms);
+    unit_param_row = -1;
+    unit_param_file = NULL;
+}
+
+/*
+ *  Fork isolation. A forked test cannot touch the rest of the suite with a
+ *  crash, a call to exit() or a corrupted heap. The child sends its results
+ *  back to the runner through a pipe. Tests are forked when USE_ISOLATION is
+ *  2, or when they are run in parallel with --jobs.
+ */
+typedef struct {
+    int pass;
+    int fail;
+    uint64_t rows;
+    uint64_t rows_failed;
+    uint64_t cases_run;
+    uint64_t duration;
+    unsigned int memory_allocated;
+    unsigned int memory_pool;
+} unit_result_t;
+
+UNIT_FUNC uint64_t unit_now(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+UNIT_FUNC void unit_run_test_local(test_list_t *test) {
+
+    reset_mocks_and_stubs();
+#if USE_MEMORY == 1
+    reset_memory_stats();
+    memory_pool = 0;
+#endif
+#if FILE_IO_USED == 1
+    reset_io_stats();
+    unit_vfs_reset();
+#endif
+#if USE_TIME == 1
+    reset_virtual_clock();
+#endif
+
+    // a forked test is timed by its runner, these are read after the jump
+    volatile unsigned int timeout = unit_in_child ? 0 : unit_test_timeout(test);
+    volatile int verbose = unit_verbose;
+    volatile uint64_t start = unit_now();
+
+    // the jump can come from a property or a fuzz target that made itself quiet
+    if(timeout > 0 && 0 != sigsetjmp(unit_timeout_jbuf, 1)) {
+        unit_verbose = verbose;
+        unit_report_timeout(test, timeout);
+    }
+    else {
+        if(timeout > 0)
+            unit_arm_timer(SIGALRM, timeout);
+        if(unit_isolation == 1) {
+            if(0 == sigsetjmp(unit_sig_jbuf, 1))
+                unit_call_test(test);
+            else
+                unit_report_signal(test, unit_sig_num, unit_sig_addr);
+        }
+        else
+            unit_call_test(test);
+    }
+    if(timeout > 0)
+        unit_arm_timer(SIGALRM, 0);
+    test->duration = unit_now() - start;
+
+    if(unit_prof_on)
+        unit_prof_unwind();
+}
+
+/*
+ *  Set up a forked child before it runs anything. Its stdout gets a buffer
+ *  that is not allocated, since the first output of a child that the parent
+ *  had not printed from yet would otherwise call malloc() in the middle of a
+ *  test, and a suite that mocks or counts malloc() would see a call that it
+ *  does not see when the test runs in process.
+ */
+UNIT_DATA char unit_child_stdout[BUFSIZ];
+
+UNIT_FUNC void unit_child_start(void) {
+
+    unit_in_child = 1;
+    setvbuf(stdout, unit_child_stdout, _IOLBF, sizeof(unit_child_stdout));
+}
+
+UNIT_FUNC pid_t unit_fork_test(test_list_t *test, int *fd) {
+
+    int fds[2];
+    pid_t pid;
+
+    fflush(stdout);
+    if(pipe(fds) != 0)
+        return -1;
+
+    test->started = unit_now();
+    if((pid = fork()) < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if(pid == 0) {
+        unit_result_t res;
+        memset(&res, 0, sizeof(res));
+        unit_child_start();
+        close(fds[0]);
+        unit_timer_sig = 0;
+        unit_arm_timer(SIGKILL, unit_test_timeout(test));
+#if USE_MEMORY == 1
+        unsigned int allocated = total_memory_allocated;
+#endif
+        // the child only adds the stacks of its own test to the profile
+        if(unit_prof_on)
+            unit_prof_start();
+        unit_run_test_local(test);
+        if(unit_prof_on)
+            unit_prof_report(0);
+        res.pass = test->pass;
+        res.fail = test->fail;
+        res.rows = test->rows;
+        res.rows_failed = test->rows_failed;
+        res.cases_run = test->cases_run;
+        res.duration = test->duration;
+#if USE_MEMORY == 1
+        res.memory_allocated = total_memory_allocated - allocated;
+        res.memory_pool = memory_pool;
+#endif
+        fflush(stdout);
+        if(write(fds[1], &res, sizeof(res)) != sizeof(res))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    *fd = fds[0];
+    return pid;
+}
+
+/*
+ *  Read the results of a forked test after the child has been reaped.
+ */
+UNIT_FUNC void unit_collect_test(test_list_t *test, int fd, int status) {
+
+    unit_result_t res;
+    ssize_t len = read(fd, &res, sizeof(res));
+    close(fd);
+
+    if(len == sizeof(res)) {
+        test->pass = res.pass;
+        test->fail = res.fail;
+        test->rows = res.rows;
+        test->rows_failed = res.rows_failed;
+        test->cases_run = res.cases_run;
+        test->duration = res.duration;
+#if USE_MEMORY == 1
+        total_memory_allocated += res.memory_allocated;
+        memory_pool = res.memory_pool;
+#endif
+    }
+
+    unsigned int timeout = unit_test_timeout(test);
+    uint64_t elapsed = unit_now() - test->started;
+
+    if(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL && timeout > 0 &&
+            elapsed >= (uint64_t)timeout * 1000000) {
+        test->duration = elapsed;
+        unit_report_timeout(test, timeout);
+    }
+    else if(WIFSIGNALED(status))
+        unit_report_signal(test, WTERMSIG(status), NULL);
+    else if(len != sizeof(res)) {
+        test->fail ++;
+        unit_print(test->name, 0, "FAIL", suite_name,
+                   "test exited with status %d", WEXITSTATUS(status));
+    }
+}
+
+UNIT_FUNC void unit_run_test(test_list_t *test) {
+
+    if(unit_isolation == 2 || test->snapshot) {
+        int fd;
+        int status = 0;
+        pid_t pid = unit_fork_test(test, &fd);
+
+        if(pid < 0) {
+            unit_error("cannot fork test \"%s\", running it in process", test->name);
+            unit_run_test_local(test);
+            return;
+        }
+        waitpid(pid, &status, 0);
+        unit_collect_test(test, fd, status);
+    }
+    else
+        unit_run_test_local(test);
+}
+
+/******************************************************************************
+ *  Parameterized tests. The function that is added for a parameterized test
+ *  runs all of its rows, so the test is isolated, timed and scheduled like any
+ *  other test. A file of rows is mapped and every line is parsed into a buffer
+ *  on the stack just before it runs, so a file of any size takes no more
+ *  memory than one row.
+ */
+UNIT_DATA param_source_t params[MAX_TESTS];
+
+UNIT_FUNC void unit_run_row(test_list_t *test, const void *row) {
+
+    int fail = test->fail;
+
+    if(unit_isolation == 1) {
+        // saving the signal mask is a system call, which is too slow per row
+        if(0 == sigsetjmp(unit_sig_jbuf, 0))
+            (*test->param_fptr)(test, row);
+        else {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, unit_sig_num);
+            sigprocmask(SIG_UNBLOCK, &set, NULL);
+            unit_report_signal(test, unit_sig_num, unit_sig_addr);
+        }
+    }
+    else
+        (*test->param_fptr)(test, row);
+
+    test->rows ++;
+    if(test->fail > fail)
+        test->rows_failed ++;
+}
+
+/*
+ *  Run the rows from first to last. For a file, these are byte offsets and a
+ *  line is run by the range that holds its first character.
+ */
+UNIT_FUNC void unit_run_rows(test_list_t *test, const char *data, size_t size,
+                             size_t first, size_t last) {
+
+    param_source_t *src = test->param;
+
+    if(src->file == NULL) {
+        for(size_t i = first; i < last; i++) {
+            unit_param_row = i;
+            unit_run_row(test, (const char*)src->table + i * src->size);
+        }
+        unit_param_row = -1;
+        return;
+    }
+
+    max_align_t row[src->size / sizeof(max_align_t) + 1];
+    long long line = 1;
+    size_t pos = 0;
+
+    // count the lines before the range, so that failures have the line number
+    while(pos < size) {
+        const char *nl = memchr(data + pos, '\n', size - pos);
+        if(nl == NULL || (size_t)(nl - data) >= first)
+            break;
+        pos = nl - data + 1;
+        line ++;
+    }
+    if(pos < first) {
+        const char *nl = memchr(data + pos, '\n', size - pos);
+        pos = (nl == NULL) ? size : (size_t)(nl - data) + 1;
+        line ++;
+    }
+
+    unit_param_file = src->file;
+    for(; pos < last && pos < size; line++) {
+        const char *nl = memchr(data + pos, '\n', size - pos);
+        size_t len = (nl == NULL) ? size - pos : (size_t)(nl - data) - pos;
+
+        unit_param_row = line;
+        memset(row, 0, src->size);
+        if(0 == (*src->parse)(data + pos, len, row))
+            unit_run_row(test, row);
+        pos += len + 1;
+    }
+    unit_param_row = -1;
+    unit_param_file = NULL;
+}
+
+/*
+ *  Split the rows between forked workers. Each one sends its results back in
+ *  the same way as a forked test.
+ */
+UNIT_FUNC void unit_run_workers(test_list_t *test, const char *data, size_t size,
+                                int workers) {
+
+    size_t units = (test->param->file != NULL) ? size : test->param->count;
+    pid_t pids[workers];
+    int fds[workers];
+
+    for(int w = 0; w < workers; w++) {
+        size_t first = units * w / workers;
+        size_t last = units * (w+1) / workers;
+        int pfd[2];
+
+        pids[w] = -1;
+        fflush(stdout);
+        if(pipe(pfd) != 0 || (pids[w] = fork()) < 0) {
+            unit_error("cannot fork a worker for \"%s\", running its rows in process", test->name);
+            unit_run_rows(test, data, size, first, last);
+            continue;
+        }
+
+        if(pids[w] == 0) {
+            unit_result_t res;
+            memset(&res, 0, sizeof(res));
+            unit_child_start();
+            close(pfd[0]);
+            // a worker goes with the test, when the test is killed for its timeout
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            test->pass = test->fail = 0;
+            test->rows = test->rows_failed = 0;
+#if USE_MEMORY == 1
+            unsigned int allocated = total_memory_allocated;
+#endif
+            unit_run_rows(test, data, size, first, last);
+            res.pass = test->pass;
+            res.fail = test->fail;
+            res.rows = test->rows;
+            res.rows_failed = test->rows_failed;
+#if USE_MEMORY == 1
+            res.memory_allocated = total_memory_allocated - allocated;
+#endif
+            fflush(stdout);
+            if(write(pfd[1], &res, sizeof(res)) != sizeof(res))
+                _exit(1);
+            _exit(0);
+        }
+
+        close(pfd[1]);
+        fds[w] = pfd[0];
+    }
+
+    for(int w = 0; w < workers; w++) {
+        unit_result_t res;
+        int status = 0;
+
+        if(pids[w] < 0)
+            continue;
+        waitpid(pids[w], &status, 0);
+        ssize_t len = read(fds[w], &res, sizeof(res));
+        close(fds[w]);
+
+        if(len == sizeof(res)) {
+            test->pass += res.pass;
+            test->fail += res.fail;
+            test->rows += res.rows;
+            test->rows_failed += res.rows_failed;
+#if USE_MEMORY == 1
+            total_memory_allocated += res.memory_allocated;
+#endif
+        }
+        else {
+            if(WIFSIGNALED(status))
+                unit_report_signal(test, WTERMSIG(status), NULL);
+            else {
+                test->fail ++;
+                unit_print(test->name, 0, "FAIL", suite_name,
+                           "worker exited with status %d", WEXITSTATUS(status));
+            }
+            test->rows_failed ++;
+        }
+    }
+}
+
+UNIT_FUNC void unit_run_param_test(test_list_t *test) {
+
+    param_source_t *src = test->param;
+    const char *data = NULL;
+    size_t size = 0;
+    size_t units = src->count;
+    sigjmp_buf outer;
+
+    if(src->file != NULL) {
+        struct stat st;
+        int fd = open(src->file, O_RDONLY);
+
+        if(fd < 0 || fstat(fd, &st) != 0) {
+            test->fail ++;
+            unit_print(test->name, 0, "FAIL", suite_name,
+                       "cannot open \"%s\": %s", src->file, strerror(errno));
+            if(fd >= 0)
+                close(fd);
+            return;
+        }
+
+        size = units = st.st_size;
+        if(size > 0) {
+            data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data == MAP_FAILED) {
+                test->fail ++;
+                unit_print(test->name, 0, "FAIL", suite_name,
+                           "cannot map \"%s\": %s", src->file, strerror(errno));
+                close(fd);
+                return;
+            }
+            madvise((void*)data, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    // a worker is only worth forking for a good number of rows
+    size_t per_worker = (src->file != NULL) ? 64*1024 : 1024;
+    int workers = unit_jobs;
+    if((size_t)workers > units / per_worker)
+        workers = units / per_worker;
+
+    // the rows set their own jump buffer, which belongs to the test again after
+    memcpy(outer, unit_sig_jbuf, sizeof(outer));
+    if(workers > 1)
+        unit_run_workers(test, data, size, workers);
+    else
+        unit_run_rows(test, data, size, 0, units);
+    memcpy(unit_sig_jbuf, outer, sizeof(outer));
+
+    if(data != NULL)
+        munmap((void*)data, size);
+}
+
+/******************************************************************************
+ *  Property based testing. A case of a property takes every value that it
+ *  generates from a list of choices. While cases are searched, the choices
+ *  come from the PRNG and are recorded. To shrink a failing case, smaller
+ *  lists are made from the recorded one and played back into the property.
+ *  Since the shrinking works on the choices and not on the values, every
+ *  generator shrinks without knowing how to. A list is smaller than another if
+ *  it is shorter, or the same length and smaller at the first difference.
+ *  A shorter list means fewer items in the buffers and sequences, and since a
+ *  choice of 0 is the simplest value of every generator, lower choices mean
+ *  simpler values.
+ */
+typedef struct {
+    uint64_t rng;
+    uint64_t choices[MAX_PROP_CHOICES];
+    int count;          // number of choices recorded, or to play back
+    int pos;            // next choice to use
+    int replay;         // take the choices from the list instead of the PRNG
+    int report;         // print the values that are generated
+    size_t used;        // bytes of the arena that are in use
+} unit_prop_t;
+
+UNIT_DATA unit_prop_t unit_prop;
+UNIT_DATA max_align_t unit_prop_arena[MAX_PROP_BYTES / sizeof(max_align_t) + 1];
+UNIT_DATA uint64_t unit_prop_best[MAX_PROP_CHOICES];
+UNIT_DATA int unit_prop_best_count = 0;
+
+// the most times that the property is run to shrink a case
+#define UNIT_SHRINK_RUNS 20000
+
+UNIT_FUNC uint64_t unit_splitmix(uint64_t *state) {
+
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/*
+ *  Draw a choice from 0 to bound. When biased, a new choice is 0 or the bound
+ *  more often than the others, since the edges are where the bugs are.
+ */
+UNIT_FUNC uint64_t unit_choice(uint64_t bound, int biased) {
+
+    uint64_t c;
+
+    if(unit_prop.replay) {
+        c = (unit_prop.pos < unit_prop.count) ? unit_prop.choices[unit_prop.pos] : 0;
+    }
+    else {
+        c = unit_splitmix(&unit_prop.rng);
+        if(biased && (c & 0x7) == 0)
+            c = 0;
+        else if(biased && (c & 0xf) == 1)
+            c = bound;
+        else
+            c >>= 4;
+    }
+
+    if(bound != UINT64_MAX)
+        c %= bound + 1;
+
+    // reading past the end of a played back list extends it with zeros
+    if(unit_prop.pos < MAX_PROP_CHOICES) {
+        unit_prop.choices[unit_prop.pos] = c;
+        if(unit_prop.pos >= unit_prop.count)
+            unit_prop.count = unit_prop.pos + 1;
+    }
+    unit_prop.pos ++;
+    return c;
+}
+
+UNIT_FUNC void *unit_prop_alloc(size_t *len, size_t size) {
+
+    size_t avail = (sizeof(unit_prop_arena) - unit_prop.used) / size;
+    char *ptr = (char*)unit_prop_arena + unit_prop.used;
+
+    if(*len > avail) {
+        unit_error("property generated more than MAX_PROP_BYTES (%d)", MAX_PROP_BYTES);
+        *len = avail;
+    }
+    // keep the next allocation aligned for an int
+    unit_prop.used += (*len * size + sizeof(int) - 1) & ~(sizeof(int) - 1);
+    return ptr;
+}
+
+UNIT_FUNC int64_t unit_gen_int(int64_t lo, int64_t hi) {
+
+    int64_t v;
+
+    if(hi < lo) {
+        int64_t t = lo;
+        lo = hi;
+        hi = t;
+    }
+    // the value moves away from 0, or from the end of the range nearest to
+    // it, and a range around 0 takes the sign first so that the size of the
+    // value shrinks on its own
+    if(lo >= 0)
+        v = (int64_t)((uint64_t)lo + unit_choice((uint64_t)hi - (uint64_t)lo, 1));
+    else if(hi <= 0)
+        v = (int64_t)((uint64_t)hi - unit_choice((uint64_t)hi - (uint64_t)lo, 1));
+    else if(unit_choice(1, 0) == 0)
+        v = (int64_t)unit_choice((uint64_t)hi, 1);
+    else
+        v = (int64_t)(0 - unit_choice(-(uint64_t)lo, 1));
+
+    if(unit_prop.report)
+        unit_print(__func__, 0, "MSG", suite_name, "generated %lld", (long long)v);
+    return v;
+}
+
+UNIT_FUNC void *unit_gen_buffer(size_t min, size_t max, size_t *len) {
+
+    size_t n = min + unit_choice(max - min, 1);
+    unsigned char *buf = (unsigned char*)unit_prop_alloc(&n, 1);
+
+    for(size_t i = 0; i < n; i++)
+        buf[i] = (unsigned char)unit_choice(255, 1);
+    *len = n;
+
+    if(unit_prop.report) {
+        char hex[3*16+4] = "";
+        for(size_t i = 0; i < n && i < 16; i++)
+            snprintf(&hex[3*i], 4, " %02x", buf[i]);
+        unit_print(__func__, 0, "MSG", suite_name, "generated %zu bytes:%s%s",
+                   n, hex, (n > 16) ? " ..." : "");
+    }
+    return buf;
+}
+
+/*
+ *  Every operation after the minimum is preceded by a choice to go on, so the
+ *  shrinker can remove an operation from the middle of a sequence by removing
+ *  two choices, and end the sequence by zeroing one.
+ */
+UNIT_FUNC int *unit_gen_ops(int n, size_t min, size_t max, size_t *len) {
+
+    size_t avail = max;
+    int *ops = (int*)unit_prop_alloc(&avail, sizeof(int));
+    size_t count = 0;
+
+    while(count < avail) {
+        if(count >= min && unit_choice(15, 0) == 0)
+            break;
+        ops[count++] = (int)unit_choice(n > 0 ? n-1 : 0, 0);
+    }
+    *len = count;
+
+    if(unit_prop.report) {
+        char text[128] = "";
+        size_t tlen = 0;
+        for(size_t i = 0; i < count && tlen < sizeof(text) - 16; i++)
+            tlen += snprintf(&text[tlen], sizeof(text) - tlen, " %d", ops[i]);
+        unit_print(__func__, 0, "MSG", suite_name, "generated %zu operations:%s%s",
+                   count, text, (tlen >= sizeof(text) - 16) ? " ..." : "");
+    }
+    return ops;
+}
+
+/*
+ *  Run one case of the property with the choices that are set up. Returns
+ *  non-zero if it failed.
+ */
+UNIT_FUNC int unit_prop_run(test_list_t *test) {
+
+    int fail = test->fail;
+
+    unit_prop.pos = 0;
+    unit_prop.used = 0;
+    reset_mocks_and_stubs();
+#if USE_MEMORY == 1
+    reset_memory_stats();
+    memory_pool = 0;
+#endif
+#if FILE_IO_USED == 1
+    reset_io_stats();
+    unit_vfs_reset();
+#endif
+#if USE_TIME == 1
+    reset_virtual_clock();
+#endif
+
+    if(unit_isolation == 1) {
+        if(0 == sigsetjmp(unit_sig_jbuf, 0))
+            (*test->prop_fptr)(test);
+        else {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, unit_sig_num);
+            sigprocmask(SIG_UNBLOCK, &set, NULL);
+            if(unit_prop.report)
+                unit_report_signal(test, unit_sig_num, unit_sig_addr);
+            else
+                test->fail ++;
+        }
+    }
+    else
+        (*test->prop_fptr)(test);
+
+    // the choices after the last one that was used do not matter
+    if(unit_prop.pos < unit_prop.count)
+        unit_prop.count = unit_prop.pos;
+
+    return test->fail > fail;
+}
+
+UNIT_FUNC void unit_prop_case(int idx) {
+
+    uint64_t state = unit_seed + (uint64_t)idx * 0xd1342543de82ef95ull;
+
+    unit_prop.rng = unit_splitmix(&state);
+    unit_prop.replay = 0;
+    unit_prop.count = 0;
+}
+
+UNIT_FUNC void unit_prop_play(const uint64_t *choices, int count) {
+
+    memcpy(unit_prop.choices, choices, count * sizeof(uint64_t));
+    unit_prop.count = count;
+    unit_prop.replay = 1;
+}
+
+/*
+ *  Run the cases from first, step at a time, and stop at the first failure.
+ *  Returns the case that failed or -1.
+ */
+UNIT_FUNC int unit_prop_search(test_list_t *test, int first, int step, uint64_t *ran) {
+
+    for(int i = first; i < test->cases; i += step) {
+        unit_prop_case(i);
+        (*ran) ++;
+        if(unit_prop_run(test))
+            return i;
+    }
+    return -1;
+}
+
+/*
+ *  Make shrink candidate idx from the best list so far. The candidates are, in
+ *  order, removing a chunk of 8, 4, 2 or 1 choices, lowering a choice by the
+ *  size of the chunk that follows it and removing the chunk, which shortens a
+ *  buffer by its first bytes, setting a chunk to zero, and lowering a single
+ *  choice by a half, a quarter, an eighth and so on down to 1, which is a
+ *  binary search for the smallest value that still fails. Returns 0 when there
+ *  are no more candidates and -1 when this one is not smaller than the best.
+ */
+UNIT_FUNC int unit_prop_candidate(long idx, uint64_t *out, int *out_count) {
+
+    const uint64_t *best = unit_prop_best;
+    int n = unit_prop_best_count;
+    static const int chunks[] = { 8, 4, 2, 1 };
+
+    for(int pass = 0; pass < 3; pass++)
+        for(int c = 0; c < 4; c++) {
+            int k = chunks[c];
+            long num = (pass == 1) ? n - k : n - k + 1;
+            if(num < 0)
+                num = 0;
+            if(idx >= num) {
+                idx -= num;
+                continue;
+            }
+
+            memcpy(out, best, n * sizeof(uint64_t));
+            if(pass == 0 || pass == 1) {
+                int at = idx + pass;
+                if(pass == 1) {
+                    if(out[idx] < (uint64_t)k)
+                        return -1;
+                    out[idx] -= k;
+                }
+                memmove(&out[at], &out[at+k], (n - at - k) * sizeof(uint64_t));
+                *out_count = n - k;
+                return 1;
+            }
+
+            int same = 1;
+            for(int i = idx; i < idx + k; i++) {
+                if(out[i] != 0)
+                    same = 0;
+                out[i] = 0;
+            }
+            *out_count = n;
+            return same ? -1 : 1;
+        }
+
+    if(idx >= 64L * n)
+        return 0;
+
+    memcpy(out, best, n * sizeof(uint64_t));
+    *out_count = n;
+    uint64_t *v = &out[idx / 64];
+    int shift = idx % 64;
+    uint64_t step = (shift == 0) ? *v - (*v >> 1) : *v >> shift;
+    if(step == 0)
+        return -1;
+    *v -= step;
+    return 1;
+}
+
+UNIT_FUNC int unit_prop_smaller(const uint64_t *a, int na, const uint64_t *b, int nb) {
+
+    if(na != nb)
+        return na < nb;
+    for(int i = 0; i < na; i++)
+        if(a[i] != b[i])
+            return a[i] < b[i];
+    return 0;
+}
+
+/*
+ *  Try the candidates from first, step at a time, and stop at the first one
+ *  that still fails and is smaller than the best list. Returns it or -1.
+ */
+UNIT_FUNC long unit_prop_try(test_list_t *test, long first, long step, long *runs) {
+
+    static uint64_t cand[MAX_PROP_CHOICES];
+    int count;
+    int r;
+
+    for(long idx = first; (r = unit_prop_candidate(idx, cand, &count)) != 0; idx += step) {
+        if(r < 0)
+            continue;
+        if((*runs)++ >= UNIT_SHRINK_RUNS)
+            break;
+        unit_prop_play(cand, count);
+        if(unit_prop_run(test) &&
+                unit_prop_smaller(unit_prop.choices, unit_prop.count,
+                                  unit_prop_best, unit_prop_best_count))
+            return idx;
+    }
+    return -1;
+}
+
+/*
+ *  Run a search in forked workers. Worker w starts at first + w and steps by
+ *  the number of workers, so the lowest result of all of them is the one that
+ *  a single process would have found. The search is either of the cases or of
+ *  the shrink candidates.
+ */
+UNIT_FUNC long unit_prop_workers(test_list_t *test, int workers, int cases, long *count) {
+
+    pid_t pids[workers];
+    int fds[workers];
+    long found = -1;
+
+    fflush(stdout);
+    for(int w = 0; w < workers; w++) {
+        int pfd[2];
+
+        if(pipe(pfd) != 0 || (pids[w] = fork()) < 0) {
+            unit_error("cannot fork a worker for \"%s\"", test->name);
+            pids[w] = -1;
+            continue;
+        }
+
+        if(pids[w] == 0) {
+            long res[2] = { -1, 0 };
+            unit_child_start();
+            close(pfd[0]);
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if(cases) {
+                uint64_t ran = 0;
+                res[0] = unit_prop_search(test, w, workers, &ran);
+                res[1] = ran;
+            }
+            else {
+                long runs = *count;
+                res[0] = unit_prop_try(test, w, workers, &runs);
+                res[1] = runs - *count;
+            }
+            if(write(pfd[1], res, sizeof(res)) != sizeof(res))
+                _exit(1);
+            _exit(0);
+        }
+        close(pfd[1]);
+        fds[w] = pfd[0];
+    }
+
+    for(int w = 0; w < workers; w++) {
+        long res[2];
+        if(pids[w] < 0)
+            continue;
+        waitpid(pids[w], NULL, 0);
+        if(read(fds[w], res, sizeof(res)) == sizeof(res)) {
+            if(res[0] >= 0 && (found < 0 || res[0] < found))
+                found = res[0];
+            *count += res[1];
+        }
+        close(fds[w]);
+    }
+    return found;
+}
+
+/*
+ *  Shrink the failing choices that are set up. Returns the number of times
+ *  that a smaller failing case was found. The smallest one is left set up.
+ */
+UNIT_FUNC int unit_prop_shrink(test_list_t *test) {
+
+    static uint64_t cand[MAX_PROP_CHOICES];
+    long runs = 0;
+    int steps = 0;
+
+    memcpy(unit_prop_best, unit_prop.choices, unit_prop.count * sizeof(uint64_t));
+    unit_prop_best_count = unit_prop.count;
+
+    while(runs < UNIT_SHRINK_RUNS) {
+        long idx;
+        int count = 0;
+
+        if(unit_jobs > 1)
+            idx = unit_prop_workers(test, unit_jobs, 0, &runs);
+        else
+            idx = unit_prop_try(test, 0, 1, &runs);
+        if(idx < 0)
+            break;
+
+        // a worker found it, so run it here to get the choices that it used
+        unit_prop_candidate(idx, cand, &count);
+        unit_prop_play(cand, count);
+        if(!unit_prop_run(test))
+            break;
+
+        memcpy(unit_prop_best, unit_prop.choices, unit_prop.count * sizeof(uint64_t));
+        unit_prop_best_count = unit_prop.count;
+        steps ++;
+    }
+
+    unit_prop_play(unit_prop_best, unit_prop_best_count);
+    return steps;
+}
+
+UNIT_FUNC void unit_run_property(test_list_t *test) {
+
+    int verbose = unit_verbose;
+    int pass = test->pass;
+    int fail = test->fail;
+    uint64_t ran = 0;
+    sigjmp_buf outer;
+    int found;
+
+    if(!unit_have_seed) {
+        unit_seed = unit_now() ^ ((uint64_t)getpid() << 32);
+        unit_have_seed = 1;
+    }
+
+    // the cases and the shrinking are silent, only the result is reported
+    memcpy(outer, unit_sig_jbuf, sizeof(outer));
+    unit_verbose = 0;
+    unit_prop.report = 0;
+    if(unit_jobs > 1 && test->cases > 1) {
+        long count = 0;
+        found = unit_prop_workers(test, unit_jobs, 1, &count);
+        ran = count;
+        // the workers ran cases past the first failure, only count up to it
+        if(found >= 0)
+            ran = found + 1;
+    }
+    else
+        found = unit_prop_search(test, 0, 1, &ran);
+
+    int steps = 0;
+    if(found >= 0) {
+        unit_prop_case(found);
+        unit_prop_run(test);
+        steps = unit_prop_shrink(test);
+    }
+    test->pass = pass;
+    test->fail = fail;
+    test->cases_run = ran;
+    unit_verbose = verbose;
+
+    if(found < 0) {
+        test->pass ++;
+        if(unit_verbose >= 2)
+            unit_print(test->name, 0, "PASS", suite_name, "property held for %d cases", test->cases);
+    }
+    else {
+        test->fail ++;
+        unit_print(test->name, 0, "FAIL", suite_name,
+                   "property falsified by case %d of %d, seed %llu, shrunk %d times",
+                   found+1, test->cases, (unsigned long long)unit_seed, steps);
+        // run the smallest case again to report what it generated and why it failed
+        unit_prop.report = (unit_verbose >= 1);
+        unit_prop_run(test);
+        unit_prop.report = 0;
+    }
+    memcpy(unit_sig_jbuf, outer, sizeof(outer));
+}
+
+/******************************************************************************
+ *  Latency injection. A mock, a stub or a replacement function that has a
+ *  latency set takes that long every time that it is entered, so a test can
+ *  show what the code under test does when a call it depends on is slow. The
+ *  time passes on the virtual clock when the suite uses it, and a test that
+ *  waits for a timeout runs at once. Otherwise it is burned on the real clock.
+ *  The random latencies come from a generator of their own, seeded by the
+ *  test, so a run gives the same latencies every time.
+ */
+UNIT_FUNC int unit_set_latency(const char *name, int dist, uint64_t ns, uint64_t max,
+                               uint64_t seed) {
+
+    int i;
+
+    for(i = 0; i < latency_idx && strcmp(latencies[i].name, name); i++)
+        ;
+    if(i == MAX_LATENCIES) {
+        unit_error("cannot set the latency of \"%s\", increase MAX_LATENCIES (%d)",
+                   name, MAX_LATENCIES);
+        return -1;
+    }
+    if(i == latency_idx)
+        latency_idx ++;
+
+    unit_msg(5, "latency for \"%s\": %llu to %llu ns", name,
+             (unsigned long long)ns, (unsigned long long)max);
+    latencies[i].name = name;
+    latencies[i].dist = dist;
+    latencies[i].ns = ns;
+    latencies[i].max = (max > ns) ? max : ns;
+    latencies[i].rng = seed;
+    return 0;
+}
+
+UNIT_FUNC void unit_clear_latency(const char *name) {
+
+    for(int i = 0; i < latency_idx; i++)
+        if(!strcmp(latencies[i].name, name))
+            latencies[i] = latencies[--latency_idx];
+}
+
+/*
+ *  The heavy tail is a Pareto distribution with an alpha of 1. Half of the
+ *  calls take at least twice the least latency, one in a thousand at least a
+ *  thousand times it, up to the most latency.
+ */
+UNIT_FUNC uint64_t unit_latency_draw(unit_latency_t *lat) {
+
+    uint64_t r;
+
+    switch(lat->dist) {
+        case UNIT_LATENCY_UNIFORM:
+            return lat->ns + unit_splitmix(&lat->rng) % (lat->max - lat->ns + 1);
+        case UNIT_LATENCY_PARETO:
+            r = unit_splitmix(&lat->rng) >> 32;
+            double d = (double)lat->ns * 4294967296.0 / (double)(r + 1);
+            return (d >= (double)lat->max) ? lat->max : (uint64_t)d;
+        default:
+            return lat->ns;
+    }
+}
+
+UNIT_FUNC void unit_inject_latency(const char *name) {
+
+    if(latency_idx == 0)
+        return;
+
+    for(int i = 0; i < latency_idx; i++) {
+        if(strcmp(latencies[i].name, name))
+            continue;
+
+        uint64_t ns = unit_latency_draw(&latencies[i]);
+        latency_injected += ns;
+#if USE_TIME == 1
+        if(unit_use_time) {
+            unit_clock += ns;
+            return;
+        }
+#endif
+        uint64_t start = unit_now();
+        while(unit_now() - start < ns)
+            ;
+        return;
+    }
+}
+
+/******************************************************************************
+ *  Coverage guided fuzzing. The compiler calls back into the driver at every
+ *  basic block of the code that is built with -fsanitize-coverage. gcc has
+ *  trace-pc, which calls back with nothing but the return address, so an edge
+ *  is hashed from the address of the block and of the one before it, the same
+ *  way as AFL. clang also has trace-pc-guard, which numbers the blocks when
+ *  the program starts. Both count the hits of an edge in one map, and a count
+ *  is put into a bucket of 1, 2, 3, 4-7, 8-15, 16-31, 32-127 or 128 and more,
+ *  so that an input that runs a loop a new number of times is also new. The
+ *  edges that a run reaches are also listed as they are first hit, so that
+ *  only those are looked at and cleared, instead of the whole map.
+ *
+ *  The callbacks are weak, so that a fuzzing runtime linked with the test
+ *  suite takes their place. They, and the fuzzer around them, must not count
+ *  themselves when the driver is compiled into an instrumented test suite.
+ */
+#define UNIT_COV_SIZE       (64*1024)
+#define UNIT_FUZZ_ARENA     (8*1024*1024)
+
+#if defined(__clang__)
+#define UNIT_NO_COVERAGE __attribute__((no_sanitize("coverage")))
+#else
+#define UNIT_NO_COVERAGE __attribute__((no_sanitize_coverage))
+#endif
+
+typedef struct {
+    size_t off;         // where the input is in the arena
+    size_t len;
+} unit_fuzz_input_t;
+
+UNIT_DATA uint8_t unit_cov[UNIT_COV_SIZE];
+UNIT_DATA uint8_t unit_cov_seen[UNIT_COV_SIZE];
+UNIT_DATA uint32_t unit_cov_hits[UNIT_COV_SIZE];
+UNIT_DATA int unit_cov_count = 0;
+UNIT_DATA uint32_t unit_cov_prev = 0;
+UNIT_DATA uint32_t unit_cov_guards = 0;
+UNIT_DATA int unit_cov_edges = 0;
+
+UNIT_DATA uint64_t unit_fuzz_runs = 0;          // --fuzz=n, 0 only runs the corpus
+UNIT_DATA const char *unit_corpus = "tests/corpus";
+UNIT_DATA uint64_t unit_fuzz_rng = 0;
+UNIT_DATA unit_fuzz_input_t unit_fuzz_inputs[MAX_FUZZ_CORPUS];
+UNIT_DATA int unit_fuzz_count = 0;
+UNIT_DATA size_t unit_fuzz_used = 0;
+UNIT_DATA uint8_t unit_fuzz_arena[UNIT_FUZZ_ARENA];
+UNIT_DATA uint8_t unit_fuzz_failed[MAX_FUZZ_LEN];
+UNIT_DATA size_t unit_fuzz_failed_len = 0;
+UNIT_DATA uint8_t unit_fuzz_buf[MAX_FUZZ_LEN];
+UNIT_DATA uint8_t *unit_fuzz_end = NULL;        // the input is copied to end here
+
+UNIT_NO_COVERAGE __attribute__((weak)) void __sanitizer_cov_trace_pc(void) {
+
+    uint32_t loc = (uint32_t)(((uintptr_t)__builtin_return_address(0) *
+                               0x9e3779b97f4a7c15ull) >> 48);
+    uint32_t edge = (loc ^ unit_cov_prev) & (UNIT_COV_SIZE-1);
+
+    if(unit_cov[edge]++ == 0 && unit_cov_count < UNIT_COV_SIZE)
+        unit_cov_hits[unit_cov_count++] = edge;
+    unit_cov_prev = loc >> 1;
+}
+
+UNIT_NO_COVERAGE __attribute__((weak)) void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop) {
+
+    // every module calls this, and may call it more than once
+    if(start == stop || *start != 0)
+        return;
+    for(uint32_t *guard = start; guard < stop; guard++)
+        *guard = ++unit_cov_guards;
+}
+
+UNIT_NO_COVERAGE __attribute__((weak)) void __sanitizer_cov_trace_pc_guard(uint32_t *guard) {
+
+    uint32_t loc = (*guard * 0x9e3779b1u) >> 16;
+    uint32_t edge = (loc ^ unit_cov_prev) & (UNIT_COV_SIZE-1);
+
+    if(unit_cov[edge]++ == 0 && unit_cov_count < UNIT_COV_SIZE)
+        unit_cov_hits[unit_cov_count++] = edge;
+    unit_cov_prev = loc >> 1;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE uint8_t unit_cov_bucket(uint8_t hits) {
+
+    if(hits <= 2)
+        return hits;
+    if(hits == 3)
+        return 4;
+    if(hits < 8)
+        return 8;
+    if(hits < 16)
+        return 16;
+    if(hits < 32)
+        return 32;
+    if(hits < 128)
+        return 64;
+    return 128;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE void unit_cov_clear(void) {
+
+    for(int k = 0; k < unit_cov_count; k++)
+        unit_cov[unit_cov_hits[k]] = 0;
+    unit_cov_count = 0;
+    unit_cov_prev = 0;
+}
+
+/*
+ *  Merge the edges of the last run into the ones seen so far. Returns non-zero
+ *  if the run reached anything new.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE int unit_cov_merge(void) {
+
+    int count = unit_cov_count;
+    int found = 0;
+
+    for(int k = 0; k < count; k++) {
+        uint32_t i = unit_cov_hits[k];
+        uint8_t bucket = unit_cov_bucket(unit_cov[i]);
+        if(bucket == 0 || (unit_cov_seen[i] & bucket))
+            continue;
+        if(unit_cov_seen[i] == 0)
+            unit_cov_edges ++;
+        unit_cov_seen[i] |= bucket;
+        found = 1;
+    }
+    return found;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE size_t unit_fuzz_rand(size_t n) {
+
+    return (n > 0) ? unit_splitmix(&unit_fuzz_rng) % n : 0;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE uint64_t unit_fuzz_hash(const uint8_t *data, size_t len) {
+
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    return hash;
+}
+
+/*
+ *  The input is placed so that it ends right before a page that cannot be
+ *  read, which is set up once and kept. If that fails, the input is still
+ *  placed at the end of a buffer, just without the guard.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE void unit_fuzz_guard(void) {
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (MAX_FUZZ_LEN + page - 1) / page * page;
+    uint8_t *map;
+
+    if(unit_fuzz_end != NULL)
+        return;
+
+    map = mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(map != MAP_FAILED && mprotect(map + size, page, PROT_NONE) == 0)
+        unit_fuzz_end = map + size;
+    else
+        unit_fuzz_end = unit_fuzz_buf + MAX_FUZZ_LEN;
+}
+
+/*
+ *  Run the target with one input. Returns non-zero if it failed. A failing
+ *  input is kept, so that it can be written out.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE int unit_fuzz_run(test_list_t *test, const uint8_t *data, size_t len) {
+
+    const uint8_t *input = unit_fuzz_end - len;
+    int fail = test->fail;
+
+    memcpy((uint8_t*)input, data, len);
+    reset_mocks_and_stubs();
+#if USE_MEMORY == 1
+    reset_memory_stats();
+    memory_pool = 0;
+#endif
+#if FILE_IO_USED == 1
+    reset_io_stats();
+    unit_vfs_reset();
+#endif
+#if USE_TIME == 1
+    reset_virtual_clock();
+#endif
+    unit_cov_clear();
+
+    if(unit_isolation != 0) {
+        if(0 == sigsetjmp(unit_sig_jbuf, 0))
+            (*test->fuzz_fptr)(test, input, len);
+        else {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, unit_sig_num);
+            sigprocmask(SIG_UNBLOCK, &set, NULL);
+            if(unit_verbose > 0)
+                unit_report_signal(test, unit_sig_num, unit_sig_addr);
+            else
+                test->fail ++;
+        }
+    }
+    else
+        (*test->fuzz_fptr)(test, input, len);
+
+    if(test->fail == fail)
+        return 0;
+    memcpy(unit_fuzz_failed, data, len);
+    unit_fuzz_failed_len = len;
+    return 1;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE int unit_fuzz_keep(const uint8_t *data, size_t len) {
+
+    if(unit_fuzz_count >= MAX_FUZZ_CORPUS || UNIT_FUZZ_ARENA - unit_fuzz_used < len)
+        return -1;
+
+    unit_fuzz_inputs[unit_fuzz_count].off = unit_fuzz_used;
+    unit_fuzz_inputs[unit_fuzz_count].len = len;
+    memcpy(&unit_fuzz_arena[unit_fuzz_used], data, len);
+    unit_fuzz_used += len;
+    unit_fuzz_count ++;
+    return 0;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE int unit_fuzz_dir(test_list_t *test, char *path, size_t size) {
+
+    if(snprintf(path, size, "%s/%s", unit_corpus, test->name) >= (int)size)
+        return -1;
+    if(mkdir(unit_corpus, 0755) != 0 && errno != EEXIST)
+        return -1;
+    if(mkdir(path, 0755) != 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+/*
+ *  Write an input to the corpus directory, named by its hash. An input that is
+ *  already there is left alone. The name is left in path.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE int unit_fuzz_save(test_list_t *test, const char *prefix,
+                                              const uint8_t *data, size_t len,
+                                              char *path, size_t size) {
+
+    char dir[512];
+    int fd;
+
+    if(unit_fuzz_dir(test, dir, sizeof(dir)) != 0 ||
+            snprintf(path, size, "%s/%s%016llx", dir, prefix,
+                     (unsigned long long)unit_fuzz_hash(data, len)) >= (int)size)
+        return -1;
+
+    if((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0)
+        return (errno == EEXIST) ? 0 : -1;
+    if(write(fd, data, len) != (ssize_t)len) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ *  Write a failing input as a test that runs the target with it.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE int unit_fuzz_save_test(test_list_t *test, const uint8_t *data,
+                                                   size_t len, const char *input) {
+
+    char path[600];
+    int fd;
+    unsigned long long hash = (unsigned long long)unit_fuzz_hash(data, len);
+
+    if(snprintf(path, sizeof(path), "%s.c", input) >= (int)sizeof(path) ||
+            (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+
+    dprintf(fd, "/*\n");
+    dprintf(fd, " *  Found by fuzzing %s with seed %llu. Add this test to the\n",
+            test->name, (unsigned long long)unit_seed);
+    dprintf(fd, " *  suite with ADD_TEST(%s_%016llx).\n", test->name, hash);
+    dprintf(fd, " */\n");
+    dprintf(fd, "DEF_TEST(%s_%016llx)\n", test->name, hash);
+    if(len == 0)
+        dprintf(fd, "    %s(test, NULL, 0);\n", test->name);
+    else {
+        dprintf(fd, "    static const uint8_t data[] = {");
+        for(size_t i = 0; i < len; i++)
+            dprintf(fd, "%s0x%02x,", (i % 12 == 0) ? "\n        " : " ", data[i]);
+        dprintf(fd, "\n    };\n");
+        dprintf(fd, "    %s(test, data, sizeof(data));\n", test->name);
+    }
+    dprintf(fd, "END_TEST\n");
+    close(fd);
+    return 0;
+}
+
+/*
+ *  Run the target with the empty input and with every input in its corpus
+ *  directory. When fuzzing, the inputs are kept as the start of the corpus and
+ *  the first failure ends the run. Otherwise every
+ *  input is run and each one that fails is named. Returns the number of inputs
+ *  that failed.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE int unit_fuzz_corpus(test_list_t *test, uint64_t *runs) {
+
+    static uint8_t data[MAX_FUZZ_LEN];
+    char dir[512];
+    char path[1024];
+    struct dirent *ent;
+    DIR *dp;
+    int failed = 0;
+
+    (*runs) ++;
+    if(unit_fuzz_run(test, data, 0)) {
+        if(unit_fuzz_runs > 0)
+            return 1;
+        unit_print(test->name, 0, "FAIL", suite_name, "failed with the empty input");
+        failed ++;
+    }
+    else if(unit_fuzz_runs > 0) {
+        unit_cov_merge();
+        unit_fuzz_keep(data, 0);
+    }
+
+    if(snprintf(dir, sizeof(dir), "%s/%s", unit_corpus, test->name) >= (int)sizeof(dir) ||
+            (dp = opendir(dir)) == NULL)
+        return failed;
+
+    while((ent = readdir(dp)) != NULL) {
+        size_t nlen = strlen(ent->d_name);
+        if(ent->d_name[0] == '.' || (nlen > 2 && !strcmp(&ent->d_name[nlen-2], ".c")))
+            continue;
+        if(snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int)sizeof(path))
+            continue;
+
+        int fd = open(path, O_RDONLY);
+        if(fd < 0)
+            continue;
+        // a longer input would be cut short, and the shorter one may not fail like it did
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > (off_t)sizeof(data)) {
+            unit_error("skipped %s, its %lld bytes are more than MAX_FUZZ_LEN (%d)",
+                       path, (long long)st.st_size, MAX_FUZZ_LEN);
+            close(fd);
+            continue;
+        }
+        ssize_t len = read(fd, data, sizeof(data));
+        close(fd);
+        if(len < 0)
+            continue;
+
+        (*runs) ++;
+        if(unit_fuzz_run(test, data, len)) {
+            failed ++;
+            if(unit_fuzz_runs > 0)
+                break;
+            unit_print(test->name, 0, "FAIL", suite_name, "failed with the input in %s", path);
+        }
+        else if(unit_fuzz_runs > 0) {
+            unit_cov_merge();
+            unit_fuzz_keep(data, len);
+        }
+    }
+    closedir(dp);
+    return failed;
+}
+
+/*
+ *  Mutate an input in place, with one to eight changes. Returns the new
+ *  length. The tokens help to get through a parser of numbers and lines.
+ */
+UNIT_FUNC UNIT_NO_COVERAGE size_t unit_fuzz_mutate(uint8_t *buf, size_t len) {
+
+    static const uint8_t bytes[] = { 0x00, 0x01, 0x7f, 0x80, 0xff, ' ', '\n', '#', '-', '0', '9' };
+    static const char *tokens[] = { "0", "-1", "255", "256", "65535", "2147483647",
+                                    "4294967296", " ", "\n", "\r\n" };
+    int count = 1 << unit_fuzz_rand(4);
+
+    for(int m = 0; m < count; m++) {
+        size_t pos = unit_fuzz_rand(len);
+        size_t n;
+
+        switch(unit_fuzz_rand(len > 0 ? 9 : 2)) {
+            case 0: // insert random bytes
+                n = 1 + unit_fuzz_rand(8);
+                pos = unit_fuzz_rand(len + 1);
+                if(len + n > MAX_FUZZ_LEN)
+                    break;
+                memmove(&buf[pos+n], &buf[pos], len - pos);
+                for(size_t i = 0; i < n; i++)
+                    buf[pos+i] = (uint8_t)unit_fuzz_rand(256);
+                len += n;
+                break;
+
+            case 1: // insert a token, or a piece of another input
+                pos = unit_fuzz_rand(len + 1);
+                if(unit_fuzz_count > 1 && unit_fuzz_rand(2)) {
+                    unit_fuzz_input_t *other = &unit_fuzz_inputs[unit_fuzz_rand(unit_fuzz_count)];
+                    size_t from = unit_fuzz_rand(other->len);
+                    n = 1 + unit_fuzz_rand(other->len - from);
+                    if(other->len == 0 || len + n > MAX_FUZZ_LEN)
+                        break;
+                    memmove(&buf[pos+n], &buf[pos], len - pos);
+                    memcpy(&buf[pos], &unit_fuzz_arena[other->off + from], n);
+                }
+                else {
+                    const char *token = tokens[unit_fuzz_rand(sizeof(tokens) / sizeof(tokens[0]))];
+                    n = strlen(token);
+                    if(len + n > MAX_FUZZ_LEN)
+                        break;
+                    memmove(&buf[pos+n], &buf[pos], len - pos);
+                    memcpy(&buf[pos], token, n);
+                }
+                len += n;
+                break;
+
+            case 2: // flip a bit
+                buf[pos] ^= (uint8_t)(1 << unit_fuzz_rand(8));
+                break;
+
+            case 3: // set a random byte
+                buf[pos] = (uint8_t)unit_fuzz_rand(256);
+                break;
+
+            case 4: // set an interesting byte
+                buf[pos] = bytes[unit_fuzz_rand(sizeof(bytes))];
+                break;
+
+            case 5: // add or subtract a little
+                buf[pos] += (uint8_t)(unit_fuzz_rand(33) - 16);
+                break;
+
+            case 6: // remove some bytes
+                n = 1 + unit_fuzz_rand((len - pos < 16) ? len - pos : 16);
+                memmove(&buf[pos], &buf[pos+n], len - pos - n);
+                len -= n;
+                break;
+
+            case 7: // copy some bytes over others
+            {
+                size_t to = unit_fuzz_rand(len);
+                n = 1 + unit_fuzz_rand(len - ((pos > to) ? pos : to));
+                memmove(&buf[to], &buf[pos], n);
+                break;
+            }
+
+            case 8: // cut the input short, or splice another one onto it
+                if(unit_fuzz_count > 1 && unit_fuzz_rand(2)) {
+                    unit_fuzz_input_t *other = &unit_fuzz_inputs[unit_fuzz_rand(unit_fuzz_count)];
+                    size_t from = unit_fuzz_rand(other->len);
+                    n = other->len - from;
+                    if(pos + n > MAX_FUZZ_LEN)
+                        n = MAX_FUZZ_LEN - pos;
+                    memcpy(&buf[pos], &unit_fuzz_arena[other->off + from], n);
+                    len = pos + n;
+                }
+                else
+                    len = pos;
+                break;
+        }
+    }
+    return len;
+}
+
+UNIT_FUNC UNIT_NO_COVERAGE void unit_run_fuzz(test_list_t *test) {
+
+    int verbose = unit_verbose;
+    int pass = test->pass;
+    int fail = test->fail;
+    uint64_t runs = 0;
+    sigjmp_buf outer;
+    int failed;
+
+    if(!unit_have_seed) {
+        unit_seed = unit_now() ^ ((uint64_t)getpid() << 32);
+        unit_have_seed = 1;
+    }
+    unit_fuzz_rng = unit_seed;
+    unit_fuzz_count = 0;
+    unit_fuzz_used = 0;
+    unit_cov_edges = 0;
+    memset(unit_cov_seen, 0, sizeof(unit_cov_seen));
+    unit_fuzz_guard();
+
+    // a forked test has no handlers, but a crash has to be caught to save it
+    if(unit_isolation == 2)
+        unit_install_handlers();
+
+    // fuzzing takes as long as --fuzz asks for, so it has no timeout
+    if(unit_fuzz_runs > 0)
+        unit_arm_timer(unit_in_child ? SIGKILL : SIGALRM, 0);
+
+    memcpy(outer, unit_sig_jbuf, sizeof(outer));
+    if(unit_fuzz_runs > 0)
+        unit_verbose = 0;
+    failed = unit_fuzz_corpus(test, &runs);
+
+    if(unit_fuzz_runs > 0 && failed == 0) {
+        uint64_t start = unit_now();
+        uint64_t count;
+
+        for(count = 0; count < unit_fuzz_runs; count++) {
+            unit_fuzz_input_t *in = &unit_fuzz_inputs[unit_fuzz_rand(unit_fuzz_count)];
+            memcpy(unit_fuzz_buf, &unit_fuzz_arena[in->off], in->len);
+            size_t len = unit_fuzz_mutate(unit_fuzz_buf, in->len);
+
+            if(unit_fuzz_run(test, unit_fuzz_buf, len)) {
+                failed = 1;
+                count ++;
+                break;
+            }
+            if(unit_cov_merge() && unit_fuzz_keep(unit_fuzz_buf, len) == 0) {
+                char path[1024] = "";
+                if(unit_fuzz_save(test, "", unit_fuzz_buf, len, path, sizeof(path)) != 0)
+                    unit_error("cannot write \"%s\": %s", path, strerror(errno));
+            }
+        }
+        runs += count;
+
+        double secs = (unit_now() - start) / 1e9;
+        if(verbose > 0)
+            printf("fuzzed %s: %llu runs in %.2f s, %.0f per second, %d edges, %d inputs in the corpus\n",
+                   test->name, (unsigned long long)count, secs, (secs > 0) ? count / secs : 0.0,
+                   unit_cov_edges, unit_fuzz_count);
+    }
+
+    test->pass = pass;
+    test->fail = fail;
+    test->cases_run = runs;
+    unit_verbose = verbose;
+
+    if(failed == 0) {
+        test->pass ++;
+        if(unit_verbose >= 2)
+            unit_print(test->name, 0, "PASS", suite_name, "passed with %llu inputs",
+                       (unsigned long long)runs);
+    }
+    else if(unit_fuzz_runs == 0)
+        test->fail ++;
+    else {
+        char path[1024] = "";
+        test->fail ++;
+        if(unit_fuzz_save(test, "crash-", unit_fuzz_failed, unit_fuzz_failed_len,
+                          path, sizeof(path)) == 0 &&
+                unit_fuzz_save_test(test, unit_fuzz_failed, unit_fuzz_failed_len, path) == 0)
+            unit_print(test->name, 0, "FAIL", suite_name,
+                       "failed after %llu runs, seed %llu, the input is in %s and a test for it in %s.c",
+                       (unsigned long long)runs, (unsigned long long)unit_seed, path, path);
+        else
+            unit_print(test->name, 0, "FAIL", suite_name,
+                       "failed after %llu runs, seed %llu, cannot write the input: %s",
+                       (unsigned long long)runs, (unsigned long long)unit_seed, strerror(errno));
+
+        // run it again to report why it failed
+        memcpy(unit_fuzz_buf, unit_fuzz_failed, unit_fuzz_failed_len);
+        unit_fuzz_run(test, unit_fuzz_buf, unit_fuzz_failed_len);
+        test->pass = pass;
+        test->fail = fail + 1;
+    }
+    memcpy(unit_sig_jbuf, outer, sizeof(outer));
+}
+
+UNIT_FUNC void unit_test_done(int idx) {
+
+    tests[idx].ran = 1;
+    total_pass += tests[idx].pass;
+    total_fail += tests[idx].fail;
+    if(unit_verbose > 0) {
+        if(tests[idx].param != NULL)
+            printf("%d. %s: pass: %d, fail: %d, rows: %llu, failed rows: %llu\n",
+                   idx+1, tests[idx].name, tests[idx].pass, tests[idx].fail,
+                   (unsigned long long)tests[idx].rows,
+                   (unsigned long long)tests[idx].rows_failed);
+        else if(tests[idx].prop_fptr != NULL)
+            printf("%d. %s: pass: %d, fail: %d, cases: %llu\n",
+                   idx+1, tests[idx].name, tests[idx].pass, tests[idx].fail,
+                   (unsigned long long)tests[idx].cases_run);
+        else if(tests[idx].fuzz_fptr != NULL)
+            printf("%d. %s: pass: %d, fail: %d, runs: %llu\n",
+                   idx+1, tests[idx].name, tests[idx].pass, tests[idx].fail,
+                   (unsigned long long)tests[idx].cases_run);
+        else
+            printf("%d. %s: pass: %d, fail: %d\n",
+                   idx+1, tests[idx].name, tests[idx].pass, tests[idx].fail);
+    }
+}
+
+/*
+ *  Run the tests in the given order with up to unit_jobs of them running at
+ *  the same time. Each test is forked. When the order is longest first, this
+ *  is the LPT schedule, which keeps one worker from being left with a long
+ *  test at the end of the run.
+ */
+UNIT_FUNC void unit_run_parallel(int *order, int count) {
+
+    int slots = (unit_jobs < count) ? unit_jobs : count;
+    pid_t pids[slots];
+    int fds[slots];
+    int idxs[slots];
+    int next = 0;
+    int running = 0;
+
+    memset(pids, 0, sizeof(pids));
+
+    while(next < count || running > 0) {
+        while(running < slots && next < count) {
+            int idx = order[next++];
+            int fd;
+            pid_t pid = unit_fork_test(&tests[idx], &fd);
+
+            if(pid < 0) {
+                unit_error("cannot fork test \"%s\", running it in process", tests[idx].name);
+                unit_run_test_local(&tests[idx]);
+                unit_test_done(idx);
+                continue;
+            }
+
+            for(int s = 0; s < slots; s++)
+                if(pids[s] == 0) {
+                    pids[s] = pid;
+                    fds[s] = fd;
+                    idxs[s] = idx;
+                    break;
+                }
+            running ++;
+        }
+
+        if(running == 0)
+            continue;
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0) {
+            if(errno == EINTR)
+                continue;
+            unit_error("waitpid failed: %s", strerror(errno));
+            break;
+        }
+
+        for(int s = 0; s < slots; s++)
+            if(pids[s] == pid) {
+                unit_collect_test(&tests[idxs[s]], fds[s], status);
+                unit_test_done(idxs[s]);
+                pids[s] = 0;
+                running --;
+                break;
+            }
+    }
+}
+
+/******************************************************************************
+ *  Array compares. Integers are equal when their bytes are, so the integer
+ *  arrays and the buffers are compared with memcmp(), which the C library
+ *  vectorizes, a block at a time. Only the block that differs is looked at
+ *  byte by byte, to find where.
+ *
+ *  Floating point values that are equal can have different bytes (0.0 and
+ *  -0.0), and values that are close enough do not compare equal. The blocks
+ *  that memcmp() cannot pass are checked by a kernel written with the vector
+ *  extensions of the compiler, which is cloned for AVX2 on x86, and the eight
+ *  or four values where it finds a mismatch are checked again one by one. Two
+ *  values match when they are equal, both NaN, no further apart than the
+ *  tolerance or no more ULPs apart than allowed. The ULP distance is the
+ *  distance of the bit patterns, once the negative ones are turned into
+ *  negative numbers, so that they are ordered like the values and 0.0 and
+ *  -0.0 are the same. NaN never matches a number.
+ */
+#define UNIT_ARRAY_BLOCK 4096
+
+#if defined(__x86_64__)
+#define UNIT_ARRAY_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define UNIT_ARRAY_CLONES
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define UNIT_ARRAY_OPTIMIZE __attribute__((optimize("O3")))
+#else
+#define UNIT_ARRAY_OPTIMIZE
+#endif
+
+typedef float unit_v8f_t __attribute__((vector_size(32)));
+typedef int32_t unit_v8i_t __attribute__((vector_size(32)));
+typedef uint32_t unit_v8u_t __attribute__((vector_size(32)));
+typedef double unit_v4d_t __attribute__((vector_size(32)));
+typedef int64_t unit_v4i_t __attribute__((vector_size(32)));
+typedef uint64_t unit_v4u_t __attribute__((vector_size(32)));
+
+UNIT_FUNC size_t unit_buffer_mismatch(const void *e, const void *g, size_t size) {
+
+    const uint8_t *pe = e, *pg = g;
+
+    for(size_t off = 0; off < size; off += UNIT_ARRAY_BLOCK) {
+        size_t len = size - off < UNIT_ARRAY_BLOCK ? size - off : UNIT_ARRAY_BLOCK;
+        if(memcmp(&pe[off], &pg[off], len) != 0)
+            for(size_t i = off; i < off + len; i++)
+                if(pe[i] != pg[i])
+                    return i;
+    }
+    return size;
+}
+
+UNIT_FUNC int unit_match_f32(float e, float g, float tol, uint32_t ulps) {
+
+    int32_t ie, ig;
+
+    if(e == g || (e != e && g != g))
+        return 1;
+    if(e != e || g != g)
+        return 0;
+    if(e - g <= tol && g - e <= tol)
+        return 1;
+
+    memcpy(&ie, &e, sizeof(ie));
+    memcpy(&ig, &g, sizeof(ig));
+    ie = ie < 0 ? -(ie & INT32_MAX) : ie;
+    ig = ig < 0 ? -(ig & INT32_MAX) : ig;
+    return (ie > ig ? (uint32_t)ie - (uint32_t)ig : (uint32_t)ig - (uint32_t)ie) <= ulps;
+}
+
+UNIT_FUNC int unit_match_f64(double e, double g, double tol, uint64_t ulps) {
+
+    int64_t ie, ig;
+
+    if(e == g || (e != e && g != g))
+        return 1;
+    if(e != e || g != g)
+        return 0;
+    if(e - g <= tol && g - e <= tol)
+        return 1;
+
+    memcpy(&ie, &e, sizeof(ie));
+    memcpy(&ig, &g, sizeof(ig));
+    ie = ie < 0 ? -(ie & INT64_MAX) : ie;
+    ig = ig < 0 ? -(ig & INT64_MAX) : ig;
+    return (ie > ig ? (uint64_t)ie - (uint64_t)ig : (uint64_t)ig - (uint64_t)ie) <= ulps;
+}
+
+/*
+ *  Returns where the first group of values with a mismatch starts, or n when
+ *  there is none. The remainder that does not fill a group is left to the
+ *  caller.
+ */
+UNIT_ARRAY_CLONES UNIT_ARRAY_OPTIMIZE
+UNIT_FUNC size_t unit_match_block_f32(const float *e, const float *g, size_t n,
+                                      float tol, uint32_t ulps) {
+
+    size_t i;
+
+    for(i = 0; i + 4*8 <= n; i += 4*8) {
+        unit_v8i_t ok = ~(unit_v8i_t){0};
+        uint64_t all[4];
+
+        for(int k = 0; k < 4*8; k += 8) {
+            unit_v8f_t x, y;
+            unit_v8i_t ix, iy;
+            unit_v8u_t gt, dist;
+
+            memcpy(&x, &e[i+k], sizeof(x));
+            memcpy(&y, &g[i+k], sizeof(y));
+            memcpy(&ix, &x, sizeof(ix));
+            memcpy(&iy, &y, sizeof(iy));
+            ix = ((ix & INT32_MAX) ^ (ix >> 31)) - (ix >> 31);
+            iy = ((iy & INT32_MAX) ^ (iy >> 31)) - (iy >> 31);
+            gt = (unit_v8u_t)(ix > iy);
+            dist = (((unit_v8u_t)ix - (unit_v8u_t)iy) & gt) | (((unit_v8u_t)iy - (unit_v8u_t)ix) & ~gt);
+
+            ok &= (x == y) | ((x != x) & (y != y)) | ((x - y <= tol) & (y - x <= tol)) |
+                  ((dist <= ulps) & (x == x) & (y == y));
+        }
+
+        memcpy(all, &ok, sizeof(all));
+        if((all[0] & all[1] & all[2] & all[3]) != UINT64_MAX)
+            return i;
+    }
+    return i < n ? i : n;
+}
+
+UNIT_ARRAY_CLONES UNIT_ARRAY_OPTIMIZE
+UNIT_FUNC size_t unit_match_block_f64(const double *e, const double *g, size_t n,
+                                      double tol, uint64_t ulps) {
+
+    size_t i;
+
+    for(i = 0; i + 4*4 <= n; i += 4*4) {
+        unit_v4i_t ok = ~(unit_v4i_t){0};
+        uint64_t all[4];
+
+        for(int k = 0; k < 4*4; k += 4) {
+            unit_v4d_t x, y;
+            unit_v4i_t ix, iy;
+            unit_v4u_t gt, dist;
+
+            memcpy(&x, &e[i+k], sizeof(x));
+            memcpy(&y, &g[i+k], sizeof(y));
+            memcpy(&ix, &x, sizeof(ix));
+            memcpy(&iy, &y, sizeof(iy));
+            ix = ((ix & INT64_MAX) ^ (ix >> 63)) - (ix >> 63);
+            iy = ((iy & INT64_MAX) ^ (iy >> 63)) - (iy >> 63);
+            gt = (unit_v4u_t)(ix > iy);
+            dist = (((unit_v4u_t)ix - (unit_v4u_t)iy) & gt) | (((unit_v4u_t)iy - (unit_v4u_t)ix) & ~gt);
+
+            ok &= (x == y) | ((x != x) & (y != y)) | ((x - y <= tol) & (y - x <= tol)) |
+                  ((dist <= ulps) & (x == x) & (y == y));
+        }
+
+        memcpy(all, &ok, sizeof(all));
+        if((all[0] & all[1] & all[2] & all[3]) != UINT64_MAX)
+            return i;
+    }
+    return i < n ? i : n;
+}
+
+UNIT_FUNC size_t unit_array_mismatch_f32(const float *e, const float *g, size_t n,
+                                         float tol, uint32_t ulps) {
+
+    for(size_t off = 0; off < n; off += UNIT_ARRAY_BLOCK) {
+        size_t len = n - off < UNIT_ARRAY_BLOCK ? n - off : UNIT_ARRAY_BLOCK;
+        if(memcmp(&e[off], &g[off], len * sizeof(float)) == 0)
+            continue;
+        size_t i = off + unit_match_block_f32(&e[off], &g[off], len, tol, ulps);
+        for(; i < off + len; i++)
+            if(!unit_match_f32(e[i], g[i], tol, ulps))
+                return i;
+    }
+    return n;
+}
+
+UNIT_FUNC size_t unit_array_mismatch_f64(const double *e, const double *g, size_t n,
+                                         double tol, uint64_t ulps) {
+
+    for(size_t off = 0; off < n; off += UNIT_ARRAY_BLOCK) {
+        size_t len = n - off < UNIT_ARRAY_BLOCK ? n - off : UNIT_ARRAY_BLOCK;
+        if(memcmp(&e[off], &g[off], len * sizeof(double)) == 0)
+            continue;
+        size_t i = off + unit_match_block_f64(&e[off], &g[off], len, tol, ulps);
+        for(; i < off + len; i++)
+            if(!unit_match_f64(e[i], g[i], tol, ulps))
+                return i;
+    }
+    return n;
+}
+
+/******************************************************************************
+ *  Failure diffs. When two buffers or two long strings are not equal, the
+ *  places where they differ are printed after the failure.
+ *
+ *  Buffers are printed as hex, 16 bytes to a row, one row from each of them
+ *  for every row that differs. Strings are diffed line by line with Myers'
+ *  algorithm, in the linear space form that looks for the middle of the edit
+ *  path from both ends at once and then splits the problem there. The lines
+ *  that both strings start and end with are skipped without diffing them, and
+ *  only the next UNIT_DIFF_LINES lines of each are diffed, so a diff of large
+ *  strings takes fixed memory and its time depends on the number of changes
+ *  near the first one. The diff is printed as hunks with context, like diff
+ *  -u prints it, up to UNIT_DIFF_OUTPUT lines.
+ */
+#define UNIT_DIFF_LINES     1024
+#define UNIT_DIFF_OUTPUT    64
+#define UNIT_DIFF_CONTEXT   3
+#define UNIT_DIFF_WIDTH     120
+
+typedef struct {
+    const char *ptr;
+    size_t len;         // with the newline, if there is one
+    uint64_t hash;
+} unit_diff_line_t;
+
+typedef struct {
+    int a;
+    int b;
+    int len;
+} unit_diff_match_t;
+
+UNIT_DATA unit_diff_line_t unit_diff_a[UNIT_DIFF_LINES];
+UNIT_DATA unit_diff_line_t unit_diff_b[UNIT_DIFF_LINES];
+UNIT_DATA int unit_diff_v1[2*UNIT_DIFF_LINES+2];
+UNIT_DATA int unit_diff_v2[2*UNIT_DIFF_LINES+2];
+typedef struct {
+    char tag;           // ' ', '-' or '+'
+    int a;
+    int b;
+} unit_diff_op_t;
+
+UNIT_DATA unit_diff_match_t unit_diff_matches[UNIT_DIFF_LINES+1];
+UNIT_DATA int unit_diff_count = 0;
+UNIT_DATA unit_diff_op_t unit_diff_ops[2*UNIT_DIFF_LINES];
+
+UNIT_FUNC void unit_diff_hex_row(char tag, const uint8_t *ptr, size_t row, size_t end) {
+
+    printf("    %c%08zx ", tag, row);
+    for(size_t i = row; i < row + 16; i++)
+        if(i < end)
+            printf(" %02x", ptr[i]);
+        else
+            printf("   ");
+    printf("  |");
+    for(size_t i = row; i < end; i++)
+        putchar(ptr[i] >= 0x20 && ptr[i] < 0x7f ? ptr[i] : '.');
+    printf("|\n");
+}
+
+UNIT_FUNC void unit_diff_hex(const void *e, const void *g, size_t size) {
+
+    const uint8_t *pe = e, *pg = g;
+    size_t off = 0, bytes = 0, last = 0;
+    int rows = 0;
+
+    if(unit_verbose < 1)
+        return;
+
+    while((off += unit_buffer_mismatch(&pe[off], &pg[off], size - off)) < size) {
+        size_t row = off & ~(size_t)15;
+        size_t end = row + 16 < size ? row + 16 : size;
+
+        // the rest is not looked at, so that the diff of huge buffers is quick
+        if(rows == UNIT_DIFF_OUTPUT / 2) {
+            printf("    ... more rows differ after the first %d\n", rows);
+            return;
+        }
+        if(rows > 0 && row != last + 16)
+            printf("    ...\n");
+        unit_diff_hex_row('-', pe, row, end);
+        unit_diff_hex_row('+', pg, row, end);
+        for(size_t i = off; i < end; i++)
+            bytes += pe[i] != pg[i];
+        last = row;
+        rows ++;
+        off = end;
+    }
+
+    printf("    %zu of %zu bytes differ in %d row%s\n", bytes, size, rows, rows > 1 ? "s" : "");
+}
+
+UNIT_FUNC int unit_diff_wanted(const char *e, const char *g) {
+
+    return strchr(e, '\n') != NULL || strchr(g, '\n') != NULL ||
+           strlen(e) > 80 || strlen(g) > 80;
+}
+
+/*
+ *  Split a string into lines, up to the limit. Returns the number of lines.
+ */
+UNIT_FUNC int unit_diff_split(const char *str, size_t len, unit_diff_line_t *lines) {
+
+    int count = 0;
+
+    while(len > 0 && count < UNIT_DIFF_LINES) {
+        const char *nl = memchr(str, '\n', len);
+        size_t n = nl != NULL ? (size_t)(nl - str) + 1 : len;
+        uint64_t hash = 0xcbf29ce484222325ULL;
+
+        for(size_t i = 0; i < n; i++)
+            hash = (hash ^ (uint8_t)str[i]) * 0x100000001b3ULL;
+        lines[count].ptr = str;
+        lines[count].len = n;
+        lines[count].hash = hash;
+        count ++;
+        str += n;
+        len -= n;
+    }
+    return count;
+}
+
+UNIT_FUNC int unit_diff_same(const unit_diff_line_t *a, const unit_diff_line_t *b) {
+
+    return a->hash == b->hash && a->len == b->len && !memcmp(a->ptr, b->ptr, a->len);
+}
+
+UNIT_FUNC void unit_diff_match(int a, int b, int len) {
+
+    unit_diff_match_t *last = &unit_diff_matches[unit_diff_count > 0 ? unit_diff_count-1 : 0];
+
+    if(len <= 0)
+        return;
+    if(unit_diff_count > 0 && last->a + last->len == a && last->b + last->len == b)
+        last->len += len;
+    else {
+        unit_diff_matches[unit_diff_count].a = a;
+        unit_diff_matches[unit_diff_count].b = b;
+        unit_diff_matches[unit_diff_count].len = len;
+        unit_diff_count ++;
+    }
+}
+
+/*
+ *  Find where the shortest edit path of a and b crosses the middle, by
+ *  following the paths from the start and from the end with d edits, one more
+ *  each time, until they overlap. The diagonals that leave the edit graph are
+ *  dropped. Returns 0 when there is no such point, as a and b have no line in
+ *  common.
+ */
+UNIT_FUNC int unit_diff_bisect(int a, int n, int b, int m, int *sx, int *sy) {
+
+    const unit_diff_line_t *la = &unit_diff_a[a], *lb = &unit_diff_b[b];
+    int max_d = (n + m + 1) / 2;
+    int *v1 = &unit_diff_v1[max_d], *v2 = &unit_diff_v2[max_d];
+    int delta = n - m, front = delta & 1;
+    int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for(int k = -max_d; k < max_d; k++)
+        v1[k] = v2[k] = -1;
+    v1[1] = v2[1] = 0;
+
+    for(int d = 0; d < max_d; d++) {
+        for(int k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            int x1 = (k1 == -d || (k1 != d && v1[k1-1] < v1[k1+1])) ? v1[k1+1] : v1[k1-1] + 1;
+            int y1 = x1 - k1;
+
+            while(x1 < n && y1 < m && unit_diff_same(&la[x1], &lb[y1]))
+                x1++, y1++;
+            v1[k1] = x1;
+            if(x1 > n)
+                k1end += 2;
+            else if(y1 > m)
+                k1start += 2;
+            else if(front) {
+                int k2 = delta - k1;
+                if(k2 >= -max_d && k2 < max_d && v2[k2] != -1 && x1 >= n - v2[k2]) {
+                    *sx = x1;
+                    *sy = y1;
+                    return 1;
+                }
+            }
+        }
+
+        for(int k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            int x2 = (k2 == -d || (k2 != d && v2[k2-1] < v2[k2+1])) ? v2[k2+1] : v2[k2-1] + 1;
+            int y2 = x2 - k2;
+
+            while(x2 < n && y2 < m && unit_diff_same(&la[n-1-x2], &lb[m-1-y2]))
+                x2++, y2++;
+            v2[k2] = x2;
+            if(x2 > n)
+                k2end += 2;
+            else if(y2 > m)
+                k2start += 2;
+            else if(!front) {
+                int k1 = delta - k2;
+                if(k1 >= -max_d && k1 < max_d && v1[k1] != -1 && v1[k1] >= n - x2) {
+                    *sx = v1[k1];
+                    *sy = v1[k1] - k1;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ *  Diff lines a to a+n against lines b to b+m and add the lines that they
+ *  have in common to the matches, in order.
+ */
+UNIT_FUNC void unit_diff_range(int a, int n, int b, int m) {
+
+    int pre = 0, post = 0, x, y;
+
+    while(pre < n && pre < m && unit_diff_same(&unit_diff_a[a+pre], &unit_diff_b[b+pre]))
+        pre ++;
+    while(post < n - pre && post < m - pre &&
+          unit_diff_same(&unit_diff_a[a+n-1-post], &unit_diff_b[b+m-1-post]))
+        post ++;
+
+    unit_diff_match(a, b, pre);
+    a += pre;
+    b += pre;
+    n -= pre + post;
+    m -= pre + post;
+
+    if(n > 0 && m > 0 && unit_diff_bisect(a, n, b, m, &x, &y)) {
+        unit_diff_range(a, x, b, y);
+        unit_diff_range(a + x, n - x, b + y, m - y);
+    }
+    unit_diff_match(a + n, b + m, post);
+}
+
+/*
+ *  Print a line of a hunk from the column where the hunk starts to differ,
+ *  so that a change at the end of a long line can be seen.
+ */
+UNIT_FUNC void unit_diff_print_line(char tag, const unit_diff_line_t *line, size_t col) {
+
+    size_t len = line->len;
+    int nl = len > 0 && line->ptr[len-1] == '\n';
+
+    if(nl)
+        len --;
+    col = col < len ? col : len;
+    printf("    %c%s%.*s%s\n", tag, col > 0 ? "..." : "",
+           (int)(len - col < UNIT_DIFF_WIDTH ? len - col : UNIT_DIFF_WIDTH), line->ptr + col,
+           len - col > UNIT_DIFF_WIDTH ? "..." : "");
+    if(!nl && tag != ' ')
+        printf("    \\ no newline at the end\n");
+}
+
+/*
+ *  Print the ops from start to end as a hunk. The first lines that changed in
+ *  it set the column that all of its lines are printed from.
+ */
+UNIT_FUNC void unit_diff_hunk(int start, int end, int line) {
+
+    const unit_diff_line_t *la = NULL, *lb = NULL;
+    unit_diff_op_t *op = &unit_diff_ops[start];
+    int na = 0, nb = 0;
+    size_t col = 0;
+
+    for(int i = start; i < end; i++) {
+        na += unit_diff_ops[i].tag != '+';
+        nb += unit_diff_ops[i].tag != '-';
+        if(unit_diff_ops[i].tag == '-' && la == NULL)
+            la = &unit_diff_a[unit_diff_ops[i].a];
+        if(unit_diff_ops[i].tag == '+' && lb == NULL)
+            lb = &unit_diff_b[unit_diff_ops[i].b];
+    }
+    if(la != NULL && lb != NULL) {
+        size_t off = unit_buffer_mismatch(la->ptr, lb->ptr, la->len < lb->len ? la->len : lb->len);
+        if(off > UNIT_DIFF_WIDTH / 2)
+            col = off - UNIT_DIFF_WIDTH / 4;
+    }
+
+    // an empty side is numbered from the line before it, like diff -u does
+    printf("    @@ -%d,%d +%d,%d @@\n", line + op->a + (na > 0), na, line + op->b + (nb > 0), nb);
+    for(int i = start; i < end; i++, op++)
+        unit_diff_print_line(op->tag, op->tag == '+' ? &unit_diff_b[op->b] : &unit_diff_a[op->a],
+                             col);
+}
+
+/*
+ *  Diff two texts line by line and print the hunks.
+ */
+UNIT_FUNC void unit_diff_text(const char *e, size_t le, const char *g, size_t lg) {
+
+    size_t short_len = le < lg ? le : lg;
+    size_t pre, post = 0;
+    const char *nl;
+    int line = 0, n, m, cut, ops = 0, printed = 0, a = 0, b = 0;
+
+    if(unit_verbose < 1)
+        return;
+
+    // skip the lines that both start with, but for the context of the first change
+    pre = unit_buffer_mismatch(e, g, short_len);
+    while(pre > 0 && e[pre-1] != '\n')
+        pre --;
+    for(nl = e; (nl = memchr(nl, '\n', pre - (size_t)(nl - e))) != NULL; nl++)
+        line ++;
+    for(int c = 0; c < UNIT_DIFF_CONTEXT && pre > 0; c++) {
+        line --;
+        for(pre --; pre > 0 && e[pre-1] != '\n'; )
+            pre --;
+    }
+
+    // and the lines that both end with
+    while(post + UNIT_ARRAY_BLOCK <= short_len - pre &&
+          !memcmp(e + le - post - UNIT_ARRAY_BLOCK, g + lg - post - UNIT_ARRAY_BLOCK, UNIT_ARRAY_BLOCK))
+        post += UNIT_ARRAY_BLOCK;
+    while(post < short_len - pre && e[le-1-post] == g[lg-1-post])
+        post ++;
+    if(post > 0 && !((le - post == pre || e[le-post-1] == '\n') &&
+                     (lg - post == pre || g[lg-post-1] == '\n'))) {
+        nl = memchr(e + le - post, '\n', post);
+        post = nl != NULL ? (size_t)(e + le - nl - 1) : 0;
+    }
+    for(int c = 0; c < UNIT_DIFF_CONTEXT && post > 0; c++) {
+        nl = memchr(e + le - post, '\n', post);
+        post = nl != NULL ? (size_t)(e + le - nl - 1) : 0;
+    }
+
+    n = unit_diff_split(e + pre, le - pre - post, unit_diff_a);
+    m = unit_diff_split(g + pre, lg - pre - post, unit_diff_b);
+    cut = (n == UNIT_DIFF_LINES || m == UNIT_DIFF_LINES);
+
+    unit_diff_count = 0;
+    unit_diff_range(0, n, 0, m);
+
+    // the edit script, up to the last match when the lines were cut off
+    for(int k = 0; k <= unit_diff_count; k++) {
+        unit_diff_match_t *match = &unit_diff_matches[k];
+        int to_a = k < unit_diff_count ? match->a : n;
+        int to_b = k < unit_diff_count ? match->b : m;
+
+        if(k == unit_diff_count && k > 0 && cut)
+            break;
+        for(; a < to_a; a++, ops++)
+            unit_diff_ops[ops] = (unit_diff_op_t){ '-', a, b };
+        for(; b < to_b; b++, ops++)
+            unit_diff_ops[ops] = (unit_diff_op_t){ '+', a, b };
+        for(int i = 0; k < unit_diff_count && i < match->len; i++, a++, b++, ops++)
+            unit_diff_ops[ops] = (unit_diff_op_t){ ' ', a, b };
+    }
+
+    printf("    --- expected\n    +++ got\n");
+
+    // a hunk takes the changes that are no more than twice the context apart
+    for(int i = 0; i < ops; ) {
+        int start, end, last;
+
+        while(i < ops && unit_diff_ops[i].tag == ' ')
+            i ++;
+        if(i == ops)
+            break;
+        start = i - UNIT_DIFF_CONTEXT > 0 ? i - UNIT_DIFF_CONTEXT : 0;
+        for(last = i; i < ops && i - last <= 2 * UNIT_DIFF_CONTEXT; i++)
+            if(unit_diff_ops[i].tag != ' ')
+                last = i;
+        end = last + 1 + UNIT_DIFF_CONTEXT < ops ? last + 1 + UNIT_DIFF_CONTEXT : ops;
+        if(printed + 1 + end - start > UNIT_DIFF_OUTPUT) {
+            end = start + UNIT_DIFF_OUTPUT - printed - 1;
+            if(end > start)
+                unit_diff_hunk(start, end, line);
+            printf("    ... the diff is cut short\n");
+            return;
+        }
+        unit_diff_hunk(start, end, line);
+        printed += 1 + end - start;
+        i = end;
+    }
+
+    if(cut)
+        printf("    ... only the first %d lines after the first change were diffed\n",
+               UNIT_DIFF_LINES);
+}
+
+UNIT_FUNC void unit_diff_lines(const char *e, const char *g) {
+
+    unit_diff_text(e, strlen(e), g, strlen(g));
+}
+
+/******************************************************************************
+ *  Golden files. The output of a test is compared with a file that holds the
+ *  output that it should have. The file is mapped and compared where it is,
+ *  so a file of gigabytes costs no more than reading it once. When they
+ *  differ, the output is written next to the golden file, with ".actual"
+ *  added to its name, to be looked at or copied over it, and a diff of the
+ *  two is printed after the failure. A golden file that matches has its
+ *  ".actual" file removed.
+ *
+ *  With --update-golden, the golden files that are missing or differ are
+ *  written with the output instead, and the asserts pass.
+ */
+UNIT_DATA int unit_golden_update = 0;           // --update-golden
+UNIT_DATA const uint8_t *unit_golden_map = NULL;
+UNIT_DATA size_t unit_golden_size = 0;
+UNIT_DATA char unit_golden_msg[PATH_MAX+128];
+
+UNIT_FUNC int unit_golden_write(const char *path, const void *buf, size_t len) {
+
+    const uint8_t *ptr = buf;
+    int fd;
+
+    if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+    while(len > 0) {
+        ssize_t n = write(fd, ptr, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0) {
+            close(fd);
+            return -1;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return close(fd);
+}
+
+UNIT_FUNC void unit_golden_unmap(void) {
+
+    if(unit_golden_map != NULL)
+        munmap((void*)unit_golden_map, unit_golden_size);
+    unit_golden_map = NULL;
+    unit_golden_size = 0;
+}
+
+/*
+ *  Returns NULL when the output matches the golden file, or what is wrong.
+ *  The golden file stays mapped for unit_golden_diff() after a mismatch.
+ */
+UNIT_FUNC const char *unit_golden_check(const void *buf, size_t len, const char *path) {
+
+    char actual[PATH_MAX], tmp[PATH_MAX];
+    struct stat st;
+    int fd, found = 0;
+
+    unit_golden_unmap();
+    snprintf(actual, sizeof(actual), "%s.actual", path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    if((fd = open(path, O_RDONLY)) >= 0) {
+        if(fstat(fd, &st) == 0) {
+            found = 1;
+            if(st.st_size > 0) {
+                void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(map == MAP_FAILED) {
+                    close(fd);
+                    snprintf(unit_golden_msg, sizeof(unit_golden_msg), "cannot be mapped: %s",
+                             strerror(errno));
+                    return unit_golden_msg;
+                }
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                unit_golden_map = map;
+                unit_golden_size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    if(found && unit_golden_size == len &&
+            unit_buffer_mismatch(unit_golden_map, buf, len) == len) {
+        unit_golden_unmap();
+        unlink(actual);
+        return NULL;
+    }
+
+    if(unit_golden_update) {
+        unit_golden_unmap();
+        if(unit_golden_write(tmp, buf, len) < 0 || rename(tmp, path) < 0) {
+            snprintf(unit_golden_msg, sizeof(unit_golden_msg), "cannot be updated: %s",
+                     strerror(errno));
+            unlink(tmp);
+            return unit_golden_msg;
+        }
+        unlink(actual);
+        printf("updated golden file \"%s\"\n", path);
+        return NULL;
+    }
+
+    if(!found)
+        snprintf(unit_golden_msg, sizeof(unit_golden_msg), "is missing");
+    else {
+        size_t off = unit_buffer_mismatch(unit_golden_map, buf,
+                                          len < unit_golden_size ? len : unit_golden_size);
+        if(off < len && off < unit_golden_size)
+            snprintf(unit_golden_msg, sizeof(unit_golden_msg), "differs at byte %zu", off);
+        else
+            snprintf(unit_golden_msg, sizeof(unit_golden_msg), "has %zu bytes but the output has %zu",
+                     unit_golden_size, len);
+    }
+
+    size_t used = strlen(unit_golden_msg);
+    if(unit_golden_write(actual, buf, len) < 0)
+        snprintf(&unit_golden_msg[used], sizeof(unit_golden_msg) - used,
+                 ", and the output cannot be written to \"%s\": %s", actual, strerror(errno));
+    else
+        snprintf(&unit_golden_msg[used], sizeof(unit_golden_msg) - used,
+                 ", the output is in \"%s\"", actual);
+    return unit_golden_msg;
+}
+
+/*
+ *  Print how the output differs from the golden file, as text when neither
+ *  has a NUL byte near the start, and as hex otherwise.
+ */
+UNIT_FUNC void unit_golden_diff(const void *buf, size_t len) {
+
+    size_t head_e = unit_golden_size < 65536 ? unit_golden_size : 65536;
+    size_t head_g = len < 65536 ? len : 65536;
+
+    if(unit_golden_map == NULL)
+        return;
+
+    if(memchr(unit_golden_map, 0, head_e) == NULL && memchr(buf, 0, head_g) == NULL)
+        unit_diff_text((const char*)unit_golden_map, unit_golden_size, buf, len);
+    else
+        unit_diff_hex(unit_golden_map, buf, len < unit_golden_size ? len : unit_golden_size);
+    unit_golden_unmap();
+}
+
+/******************************************************************************
+ *  Test history. When --history=FILE is given, the duration of every test is
+ *  kept in the file, one "suite/test nanoseconds" line per test, so that one
+ *  file can be shared by several test suites. The history is used
+ *  to run the longest tests first when running in parallel, and to balance the
+ *  shards by their expected run time instead of by the number of tests. The
+ *  file is read and written with plain system calls, because a test suite may
+ *  mock malloc() and friends.
+ */
+/*
+ *  Read the times of this suite into the times array. When copy_fd is not -1,
+ *  the lines that belong to other test suites are copied to it.
+ */
+UNIT_FUNC int unit_read_history(uint64_t *times, int copy_fd) {
+
+    char buf[4096];
+    char line[256];
+    int llen = 0;
+    int found = 0;
+    ssize_t len;
+    int fd;
+
+    if(unit_history == NULL || (fd = open(unit_history, O_RDONLY)) < 0)
+        return 0;
+
+    while((len = read(fd, buf, sizeof(buf))) > 0) {
+        for(ssize_t k = 0; k < len; k++) {
+            if(buf[k] != '\n') {
+                if(llen < (int)sizeof(line)-2)
+                    line[llen++] = buf[k];
+                continue;
+            }
+
+            line[llen++] = '\n';
+            line[llen] = '\0';
+            int keep = llen;
+            llen = 0;
+
+            // the test name cannot have a '/' in it, but the suite name can
+            char *sep = strrchr(line, ' ');
+            char *slash = strrchr(line, '/');
+            if(sep == NULL || slash == NULL || slash > sep)
+                continue;
+
+            if((size_t)(slash-line) != strlen(suite_name) ||
+                    strncmp(line, suite_name, slash-line)) {
+                if(copy_fd >= 0 && write(copy_fd, line, keep) != keep)
+                    unit_error("cannot write history file: %s", strerror(errno));
+                continue;
+            }
+
+            *sep = '\0';
+            for(int i = 0; i < test_idx; i++)
+                if(!strcmp(tests[i].name, slash+1)) {
+                    times[i] = strtoull(sep+1, NULL, 10);
+                    found ++;
+                    break;
+                }
+        }
+    }
+
+    close(fd);
+    return found;
+}
+
+UNIT_FUNC void unit_load_history(void) {
+
+    uint64_t times[MAX_TESTS];
+    uint64_t sum = 0;
+    int found = 0;
+
+    memset(times, 0, sizeof(times));
+    if(0 == unit_read_history(times, -1))
+        return;
+
+    for(int i = 0; i < test_idx; i++) {
+        tests[i].expected = times[i];
+        if(times[i] > 0) {
+            sum += times[i];
+            found ++;
+        }
+    }
+
+    // tests that are not in the history yet are expected to take the average
+    for(int i = 0; found > 0 && i < test_idx; i++)
+        if(tests[i].expected == 0)
+            tests[i].expected = sum / found;
+
+    unit_have_history = (found > 0);
+}
+
+/*
+ *  The file is read again just before it is written so that the results of
+ *  other shards and other test suites that finished in the mean time are kept.
+ */
+UNIT_FUNC void unit_save_history(void) {
+
+    uint64_t times[MAX_TESTS];
+    char name[1024];
+    char line[512];
+    int fd;
+
+    if(unit_history == NULL)
+        return;
+
+    snprintf(name, sizeof(name), "%s.%d", unit_history, (int)getpid());
+    if((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        unit_error("cannot write history file \"%s\": %s", name, strerror(errno));
+        return;
+    }
+
+    memset(times, 0, sizeof(times));
+    unit_read_history(times, fd);
+
+    for(int i = 0; i < test_idx; i++) {
+        uint64_t ns = times[i];
+        if(tests[i].ran) // smooth out the noise of a single run
+            ns = (ns == 0) ? tests[i].duration : (ns + tests[i].duration) / 2;
+        if(ns == 0)
+            continue;
+
+        int len = snprintf(line, sizeof(line), "%s/%s %llu\n",
+                           suite_name, tests[i].name, (unsigned long long)ns);
+        if(write(fd, line, len) != len)
+            unit_error("cannot write history file \"%s\": %s", name, strerror(errno));
+    }
+
+    close(fd);
+    if(rename(name, unit_history) != 0)
+        unit_error("cannot replace history file \"%s\": %s", unit_history, strerror(errno));
+}
+
+/*
+ *  Longest expected duration first. Ties keep the order that the tests were
+ *  added in, so that every shard sorts the same way.
+ */
+UNIT_FUNC int unit_compare_expected(const void *a, const void *b) {
+
+    int ia = *(const int*)a;
+    int ib = *(const int*)b;
+
+    if(tests[ia].expected != tests[ib].expected)
+        return (tests[ia].expected < tests[ib].expected) ? 1 : -1;
+    return ia - ib;
+}
+
+/******************************************************************************
+ *  Test runner.
+ */
+UNIT_FUNC void unit_usage(const char *prog) {
+
+    printf("usage: %s [options] [pattern ...]\n", prog);
+    printf("  pattern         only run tests whose name matches one of the glob patterns\n");
+    printf("  --list          print the names of the selected tests and exit\n");
+    printf("  --shard=i/n     split the tests into n shards and run shard i (1 to n)\n");
+    printf("  --jobs=n        run up to n forked tests at the same time\n");
+    printf("  --history=file  keep test durations in file and use them for scheduling\n");
+    printf("  --suite=pattern only run the test suites whose name matches the glob pattern\n");
+    printf("  --seed=n        the seed for the cases of the properties and for fuzzing\n");
+    printf("  --fuzz=n        run the fuzz targets n times with mutated inputs\n");
+    printf("  --corpus=dir    the directory of the corpus of each fuzz target (%s)\n", unit_corpus);
+    printf("  --profile=file  profile the instrumented code and write its folded stacks to file\n");
+    printf("  --timeout=ms    fail a test that runs longer than this, 0 for no limit\n");
+    printf("  --update-golden write the golden files with the output where they differ\n");
+    printf("  --help          print this message and exit\n");
+}
+
+UNIT_FUNC void unit_parse_args(int argc, char **argv) {
+
+    unit_filters = &argv[1];
+    unit_num_filters = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--list"))
+            unit_list_only = 1;
+        else if(!strncmp(argv[i], "--shard=", 8)) {
+            if(2 != sscanf(&argv[i][8], "%d/%d", &unit_shard, &unit_num_shards) ||
+                    unit_num_shards < 1 || unit_shard < 1 || unit_shard > unit_num_shards) {
+                printf("%s: invalid shard \"%s\"\n", argv[0], &argv[i][8]);
+                unit_list_only = 1;
+                exit(2);
+            }
+        }
+        else if(!strncmp(argv[i], "--jobs=", 7)) {
+            unit_jobs = atoi(&argv[i][7]);
+            if(unit_jobs < 1)
+                unit_jobs = 1;
+        }
+        else if(!strncmp(argv[i], "--history=", 10))
+            unit_history = &argv[i][10];
+        else if(!strncmp(argv[i], "--suite=", 8))
+            unit_suite_filter = &argv[i][8];
+        else if(!strncmp(argv[i], "--seed=", 7)) {
+            unit_seed = strtoull(&argv[i][7], NULL, 0);
+            unit_have_seed = 1;
+        }
+        else if(!strncmp(argv[i], "--fuzz=", 7))
+            unit_fuzz_runs = strtoull(&argv[i][7], NULL, 0);
+        else if(!strncmp(argv[i], "--timeout=", 10)) {
+            long long ms = strtoll(&argv[i][10], NULL, 10);
+            if(ms < 0)
+                ms = 0;
+            if(ms > UINT_MAX)
+                ms = UINT_MAX;
+            unit_timeout_arg = ms;
+        }
+        else if(!strcmp(argv[i], "--update-golden"))
+            unit_golden_update = 1;
+        else if(!strncmp(argv[i], "--corpus=", 9))
+            unit_corpus = &argv[i][9];
+        else if(!strncmp(argv[i], "--profile=", 10)) {
+            // every suite of a runner adds to the same file
+            unit_prof_file = &argv[i][10];
+            int fd = open(unit_prof_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd >= 0)
+                close(fd);
+        }
+        else if(!strcmp(argv[i], "--help")) {
+            unit_usage(argv[0]);
+            unit_list_only = 1;
+            exit(0);
+        }
+        else if(argv[i][0] == '-') {
+            printf("%s: unknown option \"%s\"\n", argv[0], argv[i]);
+            unit_usage(argv[0]);
+            unit_list_only = 1;
+            exit(2);
+        }
+        else // collect the patterns at the front of argv
+            unit_filters[unit_num_filters++] = argv[i];
+    }
+}
+
+/*
+ *  Pick the tests to run. Without a history, a test is assigned to a shard by
+ *  a hash of its name, so the assignment does not change when tests are added
+ *  to or removed from the suite. With a history, the selected tests are
+ *  spread over the shards longest first, each one going to the shard with the
+ *  least expected run time so far. Every shard computes the same assignment,
+ *  as long as they all read the same history.
+ */
+UNIT_FUNC int unit_test_matches(test_list_t *test) {
+
+    if(unit_num_filters == 0)
+        return 1;
+
+    for(int i = 0; i < unit_num_filters; i++)
+        if(0 == fnmatch(unit_filters[i], test->name, 0))
+            return 1;
+
+    return 0;
+}
+
+UNIT_FUNC void unit_select_tests(void) {
+
+    int order[MAX_TESTS];
+    int count = 0;
+
+    unit_load_history();
+
+    for(int i = 0; i < test_idx; i++) {
+        tests[i].selected = unit_test_matches(&tests[i]);
+        if(tests[i].selected)
+            order[count++] = i;
+    }
+
+    if(unit_num_shards <= 1 || count == 0)
+        return;
+
+    if(!unit_have_history) {
+        for(int k = 0; k < count; k++) {
+            uint32_t hash = 2166136261u;
+            for(const char *str = tests[order[k]].name; *str != '\0'; str++)
+                hash = (hash ^ (uint8_t)*str) * 16777619u;
+            if((int)(hash % (uint32_t)unit_num_shards) != unit_shard-1)
+                tests[order[k]].selected = 0;
+        }
+        return;
+    }
+
+    // shards past the number of tests are always empty
+    int bins = (unit_num_shards < count) ? unit_num_shards : count;
+    uint64_t loads[bins];
+    memset(loads, 0, sizeof(loads));
+
+    qsort(order, count, sizeof(int), unit_compare_expected);
+    for(int k = 0; k < count; k++) {
+        int bin = 0;
+        for(int b = 1; b < bins; b++)
+            if(loads[b] < loads[bin])
+                bin = b;
+        loads[bin] += tests[order[k]].expected;
+        if(bin != unit_shard-1)
+            tests[order[k]].selected = 0;
+    }
+}
+
+UNIT_FUNC int unit_run_all_tests(void) {
+
+    int order[MAX_TESTS];
+    int count = 0;
+
+    unit_select_tests();
+
+    if(unit_list_only) {
+        for(int i = 0; i < test_idx; i++)
+            if(tests[i].selected)
+                printf("%s\n", tests[i].name);
+        return 0;
+    }
+
+#if USE_MEMORY==1
+    total_memory_allocated = 0;
+#endif
+
+    if(unit_isolation == 1)
+        unit_install_handlers();
+
+    if(unit_prof_file != NULL)
+        unit_prof_start();
+
+    for(int i = 0; i < test_idx; i++) {
+        if(tests[i].selected)
+            order[count++] = i;
+        else
+            total_skipped ++;
+    }
+    total_run = count;
+
+    if(count > 0)
+        unit_call_fixture(1);
+
+    if(unit_jobs > 1 && count > 1) {
+        if(unit_have_history)
+            qsort(order, count, sizeof(int), unit_compare_expected);
+        unit_run_parallel(order, count);
+    }
+    else {
+        for(int k = 0; k < count; k++) {
+            unit_run_test(&tests[order[k]]);
+            unit_test_done(order[k]);
+        }
+    }
+
+    if(count > 0)
+        unit_call_fixture(0);
+
+    if(unit_prof_file != NULL)
+        unit_prof_report(1);
+
+    unit_save_history();
+    return total_fail;
+}
+
+/******************************************************************************
+ *  Test suite registry. Every DEF_TEST_MAIN registers its suite before main()
+ *  starts, so any number of test suites can be linked into one test runner.
+ *  A stand-alone test suite is a runner with one suite in it, and it prints
+ *  its summary when the program exits as it always has.
+ */
+UNIT_FUNC void unit_register_suite(const char *name, setup_fptr_t setup,
+                                   int verbose, int isolation, int memory,
+                                   unsigned int timeout, int vfs, int time) {
+
+    if(suite_idx >= MAX_SUITES) {
+        printf("too many test suites, increase MAX_SUITES (%d)\n", MAX_SUITES);
+        exit(2);
+    }
+
+    suites[suite_idx].name = name;
+    suites[suite_idx].setup = setup;
+    suites[suite_idx].verbose = verbose;
+    suites[suite_idx].isolation = isolation;
+    suites[suite_idx].memory = memory;
+    suites[suite_idx].timeout = timeout;
+    suites[suite_idx].vfs = vfs;
+    suites[suite_idx].time = time;
+    suite_idx ++;
+}
+
+/*
+ *  Run the registered suites from first up to, but not including, last. Each
+ *  suite prints its own summary when summary is set, otherwise the summary is
+ *  left to exit_routine().
+ */
+UNIT_FUNC int unit_run_suite_range(int first, int last, int summary,
+                                   int argc, char **argv) {
+
+    int failed = 0;
+    int errors = 0;
+    int pass = 0;
+    int run = 0;
+    int num = 0;
+
+    for(int i = first; i < last; i++) {
+        if(unit_suite_filter != NULL && 0 != fnmatch(unit_suite_filter, suites[i].name, 0))
+            continue;
+
+        unit_init(&suites[i]);
+        if(summary && unit_list_only)
+            printf("%s:\n", suite_name);
+
+        (*suites[i].setup)(argc, argv);
+        failed += unit_run_all_tests();
+
+        if(summary && !unit_list_only) {
+            unit_print_summary();
+            errors += total_errors;
+            pass += total_pass;
+            run += total_run;
+        }
+        num ++;
+    }
+
+    if(last - first > 1 && !unit_list_only)
+        printf("\nall suites: suites: %d, test funcs: %d, pass: %d, fail: %d, errors: %d\n",
+               num, run, pass, failed, errors);
+
+    return failed;
+}
+
+UNIT_FUNC int unit_run_suites(int argc, char **argv) {
+
+    unit_parse_args(argc, argv);
+
+    if(suite_idx == 1)
+        atexit(exit_routine);
+
+    return unit_run_suite_range(0, suite_idx, suite_idx > 1, argc, argv);
+}
+
+#if USE_SPLIT == 1
+/******************************************************************************
+ *  Reloading test runner. The test suites are compiled with UNIT_RUNNER into
+ *  shared objects, which are loaded with dlopen(). A suite registers itself
+ *  when it is loaded, the same as when it is linked into a test runner. After
+ *  the first run, the runner watches the directories of the shared objects.
+ *  When one of them is rebuilt, it is unloaded, loaded again and only its
+ *  suites are run. The runner keeps running, so testing a rebuild does not
+ *  have to start a program or set up the other suites again.
+ *
+ *  The shared objects must be linked with -Bsymbolic, so that the code in
+ *  them calls the mocks that they define instead of the functions of the same
+ *  name in the runner, such as malloc().
+ */
+typedef struct {
+    char path[256];
+    const char *file;   // the name of the file in its directory
+    void *handle;
+    int wd;
+    int first;          // registered as suites[first] to suites[first+count-1]
+    int count;
+    int changed;
+} unit_lib_t;
+
+UNIT_DATA unit_lib_t unit_libs[MAX_SUITES];
+UNIT_DATA int unit_num_libs = 0;
+
+UNIT_FUNC void unit_unload_lib(unit_lib_t *lib) {
+
+    if(lib->handle == NULL)
+        return;
+
+    // the suites point into the shared object, so they go before it does
+    memmove(&suites[lib->first], &suites[lib->first + lib->count],
+            (suite_idx - lib->first - lib->count) * sizeof(suite_list_t));
+    suite_idx -= lib->count;
+    for(int i = 0; i < unit_num_libs; i++)
+        if(unit_libs[i].handle != NULL && unit_libs[i].first > lib->first)
+            unit_libs[i].first -= lib->count;
+
+    dlclose(lib->handle);
+    lib->handle = NULL;
+    lib->count = 0;
+}
+
+UNIT_FUNC int unit_load_lib(unit_lib_t *lib) {
+
+    unit_unload_lib(lib);
+
+    lib->first = suite_idx;
+    if((lib->handle = dlopen(lib->path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        printf("cannot load test suite: %s\n", dlerror());
+        return -1;
+    }
+
+    lib->count = suite_idx - lib->first;
+    if(lib->count == 0) {
+        printf("no test suite in \"%s\", compile it with UNIT_RUNNER\n", lib->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ *  Wait for the shared objects to change. Once one has, the events are read
+ *  until there have been none for a while, so that a build that writes
+ *  several of them, or writes one in several steps, causes a single reload.
+ */
+UNIT_FUNC int unit_wait_for_change(int fd) {
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int pending = 0;
+
+    for(;;) {
+        int n = poll(&pfd, 1, pending ? 50 : -1);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return pending ? 0 : -1;
+
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if(len <= 0)
+            return -1;
+
+        for(char *ptr = buf; ptr < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event*)ptr;
+            for(int i = 0; i < unit_num_libs; i++)
+                if(unit_libs[i].wd == event->wd && event->len > 0 &&
+                        !strcmp(event->name, unit_libs[i].file)) {
+                    unit_libs[i].changed = 1;
+                    pending = 1;
+                }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+UNIT_FUNC int unit_reload_suites(int argc, char **argv) {
+
+    int once = 0;
+    int nargs = 1;
+    int failed = 0;
+    int fd;
+
+    // take out the shared objects and the options that only apply here
+    for(int i = 1; i < argc; i++) {
+        size_t len = strlen(argv[i]);
+        if(!strcmp(argv[i], "--once"))
+            once = 1;
+        else if(!strcmp(argv[i], "--help")) {
+            unit_usage(argv[0]);
+            printf("  suite.so        load the test suite from a shared object and watch it\n");
+            printf("  --once          run the test suites once and exit instead of watching them\n");
+            exit(0);
+        }
+        else if(argv[i][0] != '-' && len > 3 && !strcmp(&argv[i][len-3], ".so")) {
+            if(unit_num_libs >= MAX_SUITES) {
+                printf("too many test suites, increase MAX_SUITES (%d)\n", MAX_SUITES);
+                return 2;
+            }
+            unit_lib_t *lib = &unit_libs[unit_num_libs++];
+            // dlopen() searches the library path for a name without a '/'
+            snprintf(lib->path, sizeof(lib->path), "%s%s",
+                     strchr(argv[i], '/') ? "" : "./", argv[i]);
+            lib->file = strrchr(lib->path, '/') + 1;
+        }
+        else
+            argv[nargs++] = argv[i];
+    }
+    unit_parse_args(nargs, argv);
+
+    for(int i = 0; i < unit_num_libs; i++)
+        if(unit_load_lib(&unit_libs[i]))
+            return 2;
+
+    failed = unit_run_suite_range(0, suite_idx, 1, nargs, argv);
+    if(once || unit_list_only)
+        return failed;
+
+    if((fd = inotify_init1(IN_CLOEXEC)) < 0) {
+        printf("cannot watch the test suites: %s\n", strerror(errno));
+        return 2;
+    }
+
+    for(int i = 0; i < unit_num_libs; i++) {
+        unit_lib_t *lib = &unit_libs[i];
+        char dir[sizeof(lib->path)];
+
+        snprintf(dir, sizeof(dir), "%.*s", (int)(lib->file - lib->path), lib->path);
+        // a linker replaces the file, so the directory is watched instead
+        if((lib->wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO)) < 0) {
+            printf("cannot watch \"%s\": %s\n", dir, strerror(errno));
+            return 2;
+        }
+    }
+
+    printf("\nwatching %d test suites for changes\n", unit_num_libs);
+    fflush(stdout);
+
+    while(0 == unit_wait_for_change(fd)) {
+        for(int i = 0; i < unit_num_libs; i++) {
+            unit_lib_t *lib = &unit_libs[i];
+            if(!lib->changed)
+                continue;
+
+            uint64_t start = unit_now();
+            lib->changed = 0;
+            printf("\nreloading test suite: %s\n", lib->path);
+            if(0 == unit_load_lib(lib)) {
+                failed = unit_run_suite_range(lib->first, lib->first + lib->count, 1, nargs, argv);
+                printf("     reloaded and ran in %.1f ms\n", (unit_now() - start) / 1e6);
+            }
+            fflush(stdout);
+        }
+    }
+
+    close(fd);
+    return failed;
+}
+#endif
+
+/*
+ *  The tests of a suite are kept in a table of MAX_TESTS. With USE_SPLIT the
+ *  table is in the driver object, so a suite cannot make it larger by
+ *  defining MAX_TESTS itself.
+ */
+UNIT_FUNC void unit_check_test_room(const char *name) {
+
+    if(test_idx >= MAX_TESTS) {
+        unit_error("cannot add test \"%s\", increase MAX_TESTS (%d)", name, MAX_TESTS);
+        exit(2);
+    }
+}
+
+UNIT_FUNC void unit_add_test(fptr_t test, const char* name) {
+
+    unit_check_test_room(name);
+    unit_msg(5, "add test name = \"%s\"", name);
+    tests[test_idx].fptr = test;
+    tests[test_idx].name = name;
+    tests[test_idx].setup = unit_next_setup;
+    tests[test_idx].teardown = unit_next_teardown;
+    test_idx ++;
+}
+
+UNIT_FUNC test_list_t *unit_find_test(const char *name) {
+
+    for(int i = test_idx - 1; i >= 0; i--)
+        if(!strcmp(tests[i].name, name))
+            return &tests[i];
+    return NULL;
+}
+
+UNIT_FUNC void unit_set_timeout(const char *name, unsigned int ms) {
+
+    test_list_t *test = unit_find_test(name);
+
+    if(test != NULL)
+        test->timeout = ms;
+    else
+        unit_error("cannot set the timeout of \"%s\", it has not been added", name);
+}
+
+UNIT_FUNC void unit_set_snapshot(const char *name) {
+
+    test_list_t *test = unit_find_test(name);
+
+    if(test != NULL)
+        test->snapshot = 1;
+    else
+        unit_error("cannot make \"%s\" a snapshot test, it has not been added", name);
+}
+
+UNIT_FUNC void unit_add_suite_setup(fixture_setup_t setup) {
+
+    unit_fixture_setup = setup;
+}
+
+UNIT_FUNC void unit_add_suite_teardown(fixture_teardown_t teardown) {
+
+    unit_fixture_teardown = teardown;
+}
+
+UNIT_FUNC void unit_add_setup(fptr_t setup) {
+
+    unit_next_setup = setup;
+}
+
+UNIT_FUNC void unit_add_teardown(fptr_t teardown) {
+
+    unit_next_teardown = teardown;
+}
+
+UNIT_FUNC void unit_add_param_test(param_fptr_t test, const char *name, size_t size,
+                                   const void *table, size_t count,
+                                   const char *file, param_parse_t parse) {
+
+    unit_check_test_room(name);
+    params[test_idx].size = size;
+    params[test_idx].table = table;
+    params[test_idx].count = count;
+    params[test_idx].file = file;
+    params[test_idx].parse = parse;
+    tests[test_idx].param_fptr = test;
+    tests[test_idx].param = &params[test_idx];
+    unit_add_test(unit_run_param_test, name);
+}
+
+UNIT_FUNC void unit_add_property(fptr_t test, const char *name, int cases) {
+
+    unit_check_test_room(name);
+    tests[test_idx].prop_fptr = test;
+    tests[test_idx].cases = cases;
+    unit_add_test(unit_run_property, name);
+}
+
+UNIT_FUNC void unit_add_fuzz(fuzz_fptr_t test, const char *name) {
+
+    unit_check_test_room(name);
+    tests[test_idx].fuzz_fptr = test;
+    unit_add_test(unit_run_fuzz, name);
+}
+
+UNIT_FUNC void unit_track_stub(const char* name) {
+
+    // only add a given name one time
+    for(int i = 0; stubs[i].name != NULL; i++) {
+        if(stubs[i].name == name) {
+            stubs[i].count = 0;
+            unit_msg(5, "stub name \"%s\" is already being tracked", name);
+            return;
+        }
+    }
+    unit_msg(5, "tracking stub name = \"%s\"", name);
+    stubs[stub_idx].name = name;
+    stub_idx ++;
+}
+
+UNIT_FUNC void unit_track_mock(const char* name) {
+
+    // only add a given name one time
+    for(int i = 0; mocks[i].name != NULL; i++) {
+        if(mocks[i].name == name) {
+            mocks[i].count = 0;
+            unit_msg(5, "mock name \"%s\" is already being tracked", name);
+            return;
+        }
+    }
+    unit_msg(5, "tracking mock name = \"%s\"", name);
+    mocks[mock_idx].name = name;
+    mock_idx ++;
+}
+
+// These function update a global data structure that can be polled then the
+// test has finished running.
+UNIT_FUNC void unit_mock_entered(const char* name) {
+
+    unit_msg(5, "mock name = \"%s\"", name);
+    unit_inject_latency(name);
+    for(int i = 0; mocks[i].name != NULL; i++)
+        if(!strcmp(mocks[i].name, name)) {
+            unit_msg(5, "mock found");
+            mocks[i].count++;
+            return;
+        }
+    unit_msg(5, "mock not found");
+}
+
+UNIT_FUNC void unit_stub_entered(const char* name) {
+
+    unit_msg(5, "stub name = \"%s\"", name);
+    unit_inject_latency(name);
+    for(int i = 0; stubs[i].name != NULL; i++)
+        if(!strcmp(stubs[i].name, name)) {
+            unit_msg(5, "stub found");
+            stubs[i].count++;
+            return;
+        }
+    unit_msg(5, "stub not found");
+    // else simply do nothing if the stub is not in the list
+}
+
+UNIT_FUNC int unit_check_mock_entered(const char* name) {
+
+    unit_msg(5, "mock name = \"%s\"", name);
+    for(int i = 0; mocks[i].name != NULL; i++)
+        if(!strcmp(mocks[i].name, name)) {
+            unit_msg(5, "mock found");
+            return mocks[i].count;
+        }
+
+    unit_msg(5, "mock not found");
+    return 0;
+}
+
+UNIT_FUNC int unit_check_stub_entered(const char* name) {
+
+    unit_msg(5, "stub name = \"%s\"", name);
+    for(int i = 0; stubs[i].name != NULL; i++)
+        if(!strcmp(stubs[i].name, name)) {
+            unit_msg(5, "stub found");
+            return stubs[i].count;
+        }
+    unit_msg(5, "stub not found");
+    return 0;
+}
+
+// Generic print routine
+UNIT_FUNC void unit_print(const char *preamble,
+                              //const char *file_name,
+                              int line_no,
+                              const char *func_name,
+                              const char *sname,
+                              const char *fmt, ...) {
+    va_list args;
+
+    //printf("%s: %s: %s: %d: %s: ", preamble, file_name, func_name, line_no, sname);
+    if(unit_param_row >= 0 && unit_param_file != NULL)
+        printf("%s[%s:%lld]: %d: %s: %s: ", preamble, unit_param_file, unit_param_row,
+               line_no, func_name, sname);
+    else if(unit_param_row >= 0)
+        printf("%s[%lld]: %d: %s: %s: ", preamble, unit_param_row, line_no, func_name, sname);
+    else
+        printf("%s: %d: %s: %s: ", preamble, line_no, func_name, sname);
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+}
+
+/******************************************************************************
+ * Memory replacement functions. These track memory used and cause a report to
+ * be printed at the end of the test suite. They are simply wrappers for the
+ * default memory allocation functions that track a little extra data. The
+ * header sends the calls made by the test suite here.
+ */
+#if USE_MEMORY==1
+
+UNIT_DATA void *(*old_malloc)(size_t) = malloc;
+UNIT_FUNC void *unit_malloc(size_t size) {
+    malloc_count ++;
+    unit_msg(5, "enter unit_malloc: size = %lu", size);
+    unit_inject_latency("malloc");
+    void *buf = old_malloc(size+sizeof(size_t));
+    *(size_t*)buf = size;
+    memory_pool += size;
+    total_memory_allocated += size;
+    test_memory_allocated += size;
+    unit_msg(5, "leave unit_malloc returning: %p", buf+sizeof(size_t));
+    return buf+sizeof(size_t);
+}
+
+UNIT_DATA void *(*old_calloc)(size_t, size_t) = calloc;
+UNIT_FUNC void *unit_calloc(size_t num, size_t size) {
+    calloc_count++;
+    unit_msg(5, "enter unit_calloc: num = %lu, size = %lu", num, size);
+    unit_inject_latency("calloc");
+    size_t bsize = num * size;
+    size_t asize = bsize+sizeof(size_t);
+    void *buf = old_malloc(asize);
+    memset(buf, 0, asize);
+    *(size_t*)buf = size;
+    memory_pool += size;
+    total_memory_allocated += size;
+    test_memory_allocated += size;
+    unit_msg(5, "leave unit_calloc returning: %p", buf+sizeof(size_t));
+    return buf+sizeof(size_t);
+}
+
+UNIT_DATA void (*old_free)(void*) = free;
+UNIT_FUNC void unit_free(void *ptr) {
+    free_count ++;
+    unit_msg(5, "enter unit_free: ptr = %p", ptr);
+    unit_inject_latency("free");
+    size_t *nptr = (size_t*)(ptr-sizeof(size_t));
+    size_t size = *nptr;
+    old_free(nptr);
+    memory_pool -= size;
+    unit_msg(5, "leave unit_free");
+}
+
+UNIT_DATA void *(*old_realloc)(void*, size_t size) = realloc;
+UNIT_FUNC void *unit_realloc(void *ptr, size_t size) {
+    realloc_count ++;
+    unit_msg(5, "enter unit_realloc: ptr = %p, size = %lu", ptr, size);
+    unit_inject_latency("realloc");
+    void *buf = ptr-sizeof(size_t);
+    size_t old_size = *(size_t*)buf;
+    buf = old_realloc(buf, size+sizeof(size_t));
+    memory_pool += size - old_size; // could be negative
+    unit_msg(5, "leave unit_realloc returning: %p", buf+sizeof(size_t));
+    return buf+sizeof(size_t);
+}
+
+UNIT_DATA char *(*old_strdup)(const char*) = strdup;
+UNIT_FUNC char *unit_strdup(const char *str) {
+    strdup_count ++;
+    unit_msg(5, "enter unit_strdup: ptr = %p", (void*)str);
+    unit_inject_latency("strdup");
+    size_t len = strlen(str)+1;
+    void *buf = old_malloc(len+sizeof(size_t));
+    char *retbuf = buf+sizeof(size_t);
+    strcpy(retbuf, str);
+    *(size_t*)buf = len;
+    memory_pool += len;
+    unit_msg(5, "leave unit_strdup returning: %p", (void*)retbuf);
+    return retbuf;
+}
+
+#endif /* USE_MEMORY */
+
+/******************************************************************************
+ * File IO replacement functions. These count the calls and the bytes that go
+ * through them and pass them on to the C library. A file that is opened counts
+ * as open until it is closed again, so a test can check that the code under
+ * test closes what it opens. The header sends the calls made by the test suite
+ * here. With USE_VFS, they go to the filesystem in memory instead.
+ */
+#if FILE_IO_USED==1
+
+UNIT_FUNC FILE *unit_fopen(const char *path, const char *mode) {
+
+    fopen_count ++;
+    unit_inject_latency("fopen");
+    unit_msg(5, "enter unit_fopen: path = \"%s\", mode = \"%s\"", path, mode);
+    FILE *fp = unit_use_vfs ? unit_vfs_fopen(path, mode) : fopen(path, mode);
+    if(fp != NULL)
+        io_files_open ++;
+    return fp;
+}
+
+UNIT_FUNC size_t unit_fread(void *ptr, size_t size, size_t nmemb, FILE *fp) {
+
+    fread_count ++;
+    unit_inject_latency("fread");
+    size_t n = fread(ptr, size, nmemb, fp);
+    io_bytes_read += n * size;
+    return n;
+}
+
+UNIT_FUNC size_t unit_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *fp) {
+
+    fwrite_count ++;
+    unit_inject_latency("fwrite");
+    size_t n = fwrite(ptr, size, nmemb, fp);
+    io_bytes_written += n * size;
+    return n;
+}
+
+UNIT_FUNC int unit_fclose(FILE *fp) {
+
+    fclose_count ++;
+    unit_inject_latency("fclose");
+    if(fp != NULL)
+        io_files_open --;
+    return fclose(fp);
+}
+
+UNIT_FUNC int unit_open(const char *path, int flags, ...) {
+
+    mode_t mode = 0;
+
+    open_count ++;
+    unit_inject_latency("open");
+    if(flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = (mode_t)va_arg(args, int);
+        va_end(args);
+    }
+    unit_msg(5, "enter unit_open: path = \"%s\", flags = 0x%x", path, flags);
+    int fd = unit_use_vfs ? unit_vfs_open(path, flags) : open(path, flags, mode);
+    if(fd >= 0)
+        io_files_open ++;
+    return fd;
+}
+
+UNIT_FUNC ssize_t unit_read(int fd, void *buf, size_t count) {
+
+    read_count ++;
+    unit_inject_latency("read");
+    unit_vfs_fd_t *vfd = unit_vfs_fd(fd);
+    ssize_t n = (vfd != NULL) ? unit_vfs_read(vfd, buf, count) : read(fd, buf, count);
+    if(n > 0)
+        io_bytes_read += (uint64_t)n;
+    return n;
+}
+
+UNIT_FUNC ssize_t unit_write(int fd, const void *buf, size_t count) {
+
+    write_count ++;
+    unit_inject_latency("write");
+    unit_vfs_fd_t *vfd = unit_vfs_fd(fd);
+    ssize_t n = (vfd != NULL) ? unit_vfs_write(vfd, buf, count) : write(fd, buf, count);
+    if(n > 0)
+        io_bytes_written += (uint64_t)n;
+    return n;
+}
+
+UNIT_FUNC int unit_close(int fd) {
+
+    close_count ++;
+    unit_inject_latency("close");
+    unit_vfs_fd_t *vfd = unit_vfs_fd(fd);
+    int res = (vfd != NULL) ? unit_vfs_close(vfd) : close(fd);
+    if(res == 0)
+        io_files_open --;
+    return res;
+}
+
+UNIT_FUNC off_t unit_lseek(int fd, off_t off, int whence) {
+
+    lseek_count ++;
+    unit_inject_latency("lseek");
+    unit_vfs_fd_t *vfd = unit_vfs_fd(fd);
+    return (vfd != NULL) ? unit_vfs_lseek(vfd, off, whence) : lseek(fd, off, whence);
+}
+
+UNIT_FUNC int unit_unlink(const char *path) {
+
+    unlink_count ++;
+    unit_inject_latency("unlink");
+    unit_msg(5, "enter unit_unlink: path = \"%s\"", path);
+    return unit_use_vfs ? unit_vfs_unlink(path) : unlink(path);
+}
+
+UNIT_FUNC void *unit_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off) {
+
+    unit_vfs_fd_t *vfd = unit_vfs_fd(fd);
+
+    mmap_count ++;
+    unit_inject_latency("mmap");
+    if(vfd == NULL || (flags & MAP_ANONYMOUS))
+        return mmap(addr, len, prot, flags, fd, off);
+    return unit_vfs_mmap(addr, len, prot, flags, vfd, off);
+}
+
+UNIT_FUNC int unit_munmap(void *addr, size_t len) {
+
+    munmap_count ++;
+    unit_inject_latency("munmap");
+    if(unit_use_vfs && unit_vfs_munmap(addr) == 0)
+        return 0;
+    return munmap(addr, len);
+}
+
+#endif /* FILE_IO_USED */
+
+/******************************************************************************
+ * Time replacement functions. These read and move the virtual clock instead
+ * of the real one, so code that sleeps or waits for a timeout runs as fast as
+ * the code itself. The clocks that measure CPU time are left to the system.
+ * The header sends the calls made by the test suite here.
+ */
+#if USE_TIME==1
+
+UNIT_FUNC int unit_clock_gettime(clockid_t id, struct timespec *ts) {
+
+    uint64_t now = unit_clock;
+
+    switch(id) {
+        case CLOCK_REALTIME:
+        case CLOCK_REALTIME_COARSE:
+            now += (uint64_t)UNIT_TIME_EPOCH * 1000000000u;
+            break;
+        case CLOCK_MONOTONIC:
+        case CLOCK_MONOTONIC_COARSE:
+        case CLOCK_MONOTONIC_RAW:
+        case CLOCK_BOOTTIME:
+            break;
+        default:
+            return clock_gettime(id, ts);
+    }
+    unit_clock += unit_clock_step;
+
+    ts->tv_sec = (time_t)(now / 1000000000u);
+    ts->tv_nsec = (long)(now % 1000000000u);
+    return 0;
+}
+
+UNIT_FUNC time_t unit_time(time_t *t) {
+
+    struct timespec ts;
+    unit_clock_gettime(CLOCK_REALTIME, &ts);
+    if(t != NULL)
+        *t = ts.tv_sec;
+    return ts.tv_sec;
+}
+
+UNIT_FUNC void unit_sleep_ns(uint64_t ns) {
+
+    sleep_count ++;
+    unit_msg(5, "virtual sleep: %llu ns", (unsigned long long)ns);
+    unit_clock += ns;
+    time_slept += ns;
+}
+
+UNIT_FUNC int unit_nanosleep(const struct timespec *req, struct timespec *rem) {
+
+    if(req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+        errno = EINVAL;
+        return -1;
+    }
+    unit_sleep_ns((uint64_t)req->tv_sec * 1000000000u + (uint64_t)req->tv_nsec);
+    if(rem != NULL)
+        rem->tv_sec = rem->tv_nsec = 0;
+    return 0;
+}
+
+UNIT_FUNC int unit_usleep(useconds_t usec) {
+
+    unit_sleep_ns((uint64_t)usec * 1000u);
+    return 0;
+}
+
+UNIT_FUNC unsigned int unit_sleep(unsigned int seconds) {
+
+    unit_sleep_ns((uint64_t)seconds * 1000000000u);
+    return 0;
+}
+
+#endif /* USE_TIME */
@@ -1,17 +1,23 @@
 /*
  * This file is included in all unit tests. It provides prototypes and macros
- * that implement the actual tests. These are simple tests that do not capture
- * exceptions and signals. The goal of these tests is to determine that
- * individual functions behave as they should.
+ * that implement the actual tests. These are simple tests. Fatal signals such
+ * as a segfault are caught so that the rest of the suite can run, but
+ * exceptions are not. The goal of these tests is to determine that individual
+ * functions behave as they should.
  */
 #ifndef _UNIT_TESTS_H_
 #define _UNIT_TESTS_H_
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
+#include "unit_hist.h"
 
 /******************************************************************************
  *  Configuration Parameters
@@ -24,13 +30,31 @@
 #define USE_MEMORY 1
 #endif
 
+/*
+ *  0 = the code under test uses the real clock
+ *  1 = use the virtual clock, which only moves when a test moves it or the
+ *      code under test sleeps
+ */
+#ifndef USE_TIME
+#define USE_TIME 0
+#endif
+
 /*
  *  0 = do not use the file IO tracking
  *  1 = Use the file IO tracking
- *
- *  (not supported yet)
  */
+#ifndef FILE_IO_USED
 #define FILE_IO_USED 0
+#endif
+
+/*
+ *  0 = the file IO replacement functions use the real filesystem
+ *  1 = use a filesystem in memory, which is empty at the start of every test
+ *      (needs FILE_IO_USED)
+ */
+#ifndef USE_VFS
+#define USE_VFS 0
+#endif
 
 /*
  *  0 = No test needs to use capture.
@@ -40,6 +64,32 @@
 #define USE_CAPTURE 0
 #endif
 
+/*
+ *  0 = the test driver is compiled into the test suite from this header.
+ *  1 = the test driver is compiled once from unit_tests.c and linked with the
+ *      test suite. Define this the same way for the suite and for the driver.
+ */
+#ifndef USE_SPLIT
+#define USE_SPLIT 0
+#endif
+
+/*
+ *  0 = no isolation. A test that crashes ends the whole suite.
+ *  1 = catch SIGSEGV, SIGBUS and SIGFPE in process and fail the test.
+ *  2 = run every test in a forked child process.
+ */
+#ifndef USE_ISOLATION
+#define USE_ISOLATION 1
+#endif
+
+/*
+ *  The time in milliseconds that a test can take before it fails, 0 for no
+ *  limit. SET_TIMEOUT() sets it for one test and --timeout=ms for all tests.
+ */
+#ifndef TEST_TIMEOUT
+#define TEST_TIMEOUT 0
+#endif
+
 /*
  *  0 = print summary only
  *  1 = print failures only
@@ -74,6 +124,53 @@
 #define MAX_TESTS   20
 #endif
 
+/*
+ *  Maximum number of test suites that can be linked into one test runner.
+ */
+#ifndef MAX_SUITES
+#define MAX_SUITES  100
+#endif
+
+/*
+ *  Maximum number of values that one case of a property can generate, and the
+ *  number of bytes for the buffers and operation sequences that it generates.
+ */
+#ifndef MAX_PROP_CHOICES
+#define MAX_PROP_CHOICES    4096
+#endif
+
+#ifndef MAX_PROP_BYTES
+#define MAX_PROP_BYTES      (64*1024)
+#endif
+
+/*
+ *  Maximum length of an input to a fuzz target, and the number of inputs that
+ *  the corpus of a fuzz target can hold while it is fuzzed.
+ */
+#ifndef MAX_FUZZ_LEN
+#define MAX_FUZZ_LEN        4096
+#endif
+
+#ifndef MAX_FUZZ_CORPUS
+#define MAX_FUZZ_CORPUS     4096
+#endif
+
+/*
+ *  Limits of the profiler: the number of threads that are profiled, the number
+ *  of distinct call stacks in each thread and the deepest call stack.
+ */
+#ifndef MAX_PROF_THREADS
+#define MAX_PROF_THREADS    16
+#endif
+
+#ifndef MAX_PROF_NODES
+#define MAX_PROF_NODES      4096
+#endif
+
+#ifndef MAX_PROF_DEPTH
+#define MAX_PROF_DEPTH      256
+#endif
+
 /******************************************************************************
  *  Macros used to implement tests.
  */
@@ -102,6 +199,20 @@
     unit_mock_entered(#n);
 #define END_MOCK }
 
+/*
+ * Wrapped mocks replace a function at link time instead of at compile time, so
+ * the module under test can be a separately compiled object. The test suite
+ * must be linked with -Wl,--wrap=n for every wrapped function "n". Calls to
+ * "n" from the other objects then go to the mock, and the mock can still call
+ * the original function with REAL(n).
+ */
+#define DEF_WRAP_MOCK(r, n, ...) \
+    r __real_##n(__VA_ARGS__); \
+    r __wrap_##n(__VA_ARGS__) { \
+    unit_mock_entered(#n);
+#define END_WRAP_MOCK }
+#define REAL(n) __real_##n
+
 /*
  * If you want to use a mock to see how many times it has been entered, then you
  * need to add it when the test begins. If it is not added then the entry of it
@@ -120,35 +231,225 @@
 #define END_TEST }
 #define ADD_TEST(n) unit_add_test(n, #n)
 
+/*
+ * Give a test that was added a timeout in milliseconds of its own, instead of
+ * TEST_TIMEOUT. A test that runs longer fails and the suite goes on. In
+ * process, the test is left with a jump, like a crash, so a test that is
+ * stopped in the middle of malloc() or while it holds a lock can hang the
+ * tests after it. A forked test is killed.
+ */
+#define SET_TIMEOUT(n, ms) unit_set_timeout(#n, (ms))
+
+/*
+ * Fixtures. The suite setup is run once, before the first test of the suite,
+ * and builds the state that the tests share, such as a large table or a
+ * module that takes a long time to start. The body fills in "fixture", a
+ * pointer to the type "t", which the tests then see through FIXTURE(t). The
+ * suite teardown is run after the last test and gets the same pointer back to
+ * free it. Neither runs when no test is selected.
+ *
+ * The fixture is shared, so a test that runs in process must only read it,
+ * which is why FIXTURE() is a pointer to const. A forked test, as with
+ * USE_ISOLATION set to 2 or --jobs, is forked after the suite setup and has a
+ * copy on write image of the fixture that it can change without affecting the
+ * tests after it.
+ *
+ * The setup and teardown of a test are run before and after the test, for
+ * every test added after ADD_SETUP() or ADD_TEARDOWN(), and count towards its
+ * results, so they can use asserts. A parameterized test, a property or a fuzz
+ * target runs them once around all of its rows, cases or inputs. A test that
+ * crashes or runs out of time does not get its teardown. The memory that the
+ * suite setup and teardown allocate and free is not counted for any test.
+ */
+#define DEF_SUITE_SETUP(n, t) void *n(void) { t *fixture = NULL;
+#define END_SUITE_SETUP return fixture; }
+#define ADD_SUITE_SETUP(n) unit_add_suite_setup(n)
+
+#define DEF_SUITE_TEARDOWN(n, t) void n(void *unit_ptr) { t *fixture = (t*)unit_ptr; (void)fixture;
+#define END_SUITE_TEARDOWN }
+#define ADD_SUITE_TEARDOWN(n) unit_add_suite_teardown(n)
+
+#define DEF_SETUP(n) void n(test_list_t *test) { (void)test;
+#define END_SETUP }
+#define ADD_SETUP(n) unit_add_setup(n)
+
+#define DEF_TEARDOWN(n) void n(test_list_t *test) { (void)test;
+#define END_TEARDOWN }
+#define ADD_TEARDOWN(n) unit_add_teardown(n)
+
+#define FIXTURE(t) ((const t*)unit_fixture)
+
+/*
+ * A snapshot test changes the fixture. SET_SNAPSHOT(), after the test is
+ * added, forks that test from the runner once the suite setup has built the
+ * fixture, whatever USE_ISOLATION is set to. The child starts from a copy on
+ * write image of everything the setup made, which costs a copy of the page
+ * tables instead of building the fixture again, and what it changes is gone
+ * when it exits. The other tests still run in process. MUTABLE_FIXTURE(t) is
+ * the fixture that a snapshot test can change. It fails the test and gives
+ * NULL to a test that is not forked.
+ */
+#define SET_SNAPSHOT(n) unit_set_snapshot(#n)
+#define MUTABLE_FIXTURE(t) ((t*)unit_mutable_fixture(test))
+
+/*
+ * A parameterized test runs its body once for every row of a table. The macro
+ * parameter "t" is the type of a row, and the body sees the current row as
+ * "param". Every row is a case of its own. A failure names the row that it
+ * happened in, and the result of the test counts the rows that failed. When
+ * USE_ISOLATION is 1, a crash only ends the row that caused it.
+ *
+ * ADD_TEST_PARAM() takes the rows from an array. ADD_TEST_PARAM_FILE() takes
+ * them from the lines of a file, which is mapped into memory and handed to the
+ * parse function a line at a time, so only one row exists at any time. The
+ * parse function has the form
+ *
+ *      int parse(const char *line, size_t len, void *row)
+ *
+ * where line is not terminated. It fills in the row and returns 0, or returns
+ * non-zero to skip the line, such as for a comment. Failures in a row from a
+ * file are reported with the line number.
+ *
+ * With --jobs=n, the rows are split between n forked workers, so very large
+ * tables run on all of the processors.
+ */
+#define DEF_TEST_PARAM(n, t) \
+    typedef t n##_param_t; \
+    void n(test_list_t *test, const void *unit_row) { \
+        const t *param = (const t*)unit_row; \
+        (void)param;
+
+#define END_TEST_PARAM }
+
+#define ADD_TEST_PARAM(n, table) \
+    do { \
+        _Static_assert(sizeof((table)[0]) == sizeof(n##_param_t), \
+                       "the rows of the table are not the type of the test"); \
+        unit_add_param_test(n, #n, sizeof(n##_param_t), (table), \
+                            sizeof(table) / sizeof((table)[0]), NULL, NULL); \
+    } while(0)
+
+#define ADD_TEST_PARAM_FILE(n, file, parse) \
+    unit_add_param_test(n, #n, sizeof(n##_param_t), NULL, 0, (file), (parse))
+
+/*
+ * A property is a test that has to hold for every input that its generators
+ * can produce. The body is run for the number of cases given to
+ * ADD_PROPERTY(), and every case draws new values from the generators below,
+ * which are driven by a seeded PRNG. The seed is printed when a property
+ * fails, and --seed=n on the command line runs the same cases again.
+ *
+ * Every value that a case draws is recorded. When a case fails, the recorded
+ * values are shrunk by removing, zeroing and reducing them and running the
+ * body again, for as long as it still fails. So a counterexample is reported
+ * in its smallest form, with the values that it generated. Smaller values,
+ * zero length buffers and short sequences are the simplest ones. With
+ * --jobs=n, both the cases and the shrinking run in n forked workers.
+ *
+ * The body has to clean up after itself, since it is run many times. The mocks
+ * and the memory statistics are reset for every case. A crash is treated as a
+ * failure and shrunk as well when USE_ISOLATION is 1.
+ *
+ *  gen_int(lo, hi)             an int64_t from lo to hi, shrinks towards 0
+ *  gen_bool()                  0 or 1
+ *  gen_buffer(min, max, len)   a buffer of random bytes, its length is stored
+ *                              in the size_t that len points to
+ *  gen_ops(n, min, max, len)   a sequence of operations from 0 to n-1, for a
+ *                              test that runs a sequence of calls against a
+ *                              model, its length is stored in len
+ *
+ * The buffers and sequences stay valid until the end of the case.
+ */
+#define DEF_PROPERTY(n) void n(test_list_t *test) {
+#define END_PROPERTY }
+#define ADD_PROPERTY(n, cases) unit_add_property(n, #n, (cases))
+
+#define gen_int(lo, hi) unit_gen_int((lo), (hi))
+#define gen_bool() ((int)unit_gen_int(0, 1))
+#define gen_buffer(min, max, len) unit_gen_buffer((min), (max), (len))
+#define gen_ops(n, min, max, len) unit_gen_ops((n), (min), (max), (len))
+
+/*
+ * A fuzz target is a test that has to pass for any input at all. The macro
+ * parameters "data" and "size" name the bytes of the input in the body. Every
+ * fuzz target has a corpus of inputs in its own directory, which is
+ * tests/corpus/ followed by the name of the target, or the one given with
+ * --corpus=dir. In a normal run, the target is run with an empty input and
+ * with every input in the corpus.
+ *
+ * With --fuzz=n on the command line, the target is then run n times more with
+ * inputs that are made by mutating the ones in the corpus. Compile the test
+ * suite with -fsanitize-coverage=trace-pc (gcc) or trace-pc-guard (clang) so
+ * that the edges of the code that each input reaches are counted. An input
+ * that reaches new edges, or reaches an edge a new number of times, is kept
+ * and written to the corpus directory. Without the coverage, the inputs are
+ * still mutated, but blindly.
+ *
+ * The first input that fails or crashes is written to the corpus directory as
+ * crash-<hash>, which makes the normal runs fail until it is fixed, and as
+ * crash-<hash>.c, which holds a DEF_TEST() that runs the target with it. The
+ * input ends just before a page that cannot be read, so reading past its end
+ * crashes. The mocks and the memory statistics are reset for every input.
+ */
+#define DEF_FUZZ(n, data, size) void n(test_list_t *test, const uint8_t *data, size_t size) {
+#define END_FUZZ }
+#define ADD_FUZZ(n) unit_add_fuzz(n, #n)
+
 /*
  * These macros implements the main() of the test. The macro parameter is the
- * display name of the test suite.
+ * display name of the test suite. The command line is handed to the test
+ * runner, which uses it to select which tests to run. See unit_usage().
+ *
+ * The body is the set up function of the test suite. It is registered before
+ * main() starts, and the test runner calls it when it is the turn of the suite
+ * to run. When UNIT_RUNNER is defined, no main() is created and the suite can
+ * be linked into a test runner together with other test suites. A test runner
+ * is created with DEF_RUNNER_MAIN.
  */
 #define DEF_TEST_MAIN(n) \
-    int main(void) { \
-        suite_name = (n); \
-        atexit(exit_routine); \
-        memset(tests, 0, sizeof(tests)); \
-        memset(mocks, 0, sizeof(mocks)); \
-        memset(stubs, 0, sizeof(stubs));
-
-#define END_TEST_MAIN \
-        return unit_run_all_tests(); \
+    static void unit_suite_setup(int argc, char **argv); \
+    __attribute__((constructor)) static void unit_suite_register(void) { \
+        unit_register_suite((n), unit_suite_setup, VERBOSE, USE_ISOLATION, USE_MEMORY, \
+                            TEST_TIMEOUT, USE_VFS, USE_TIME); \
+    } \
+    UNIT_SUITE_MAIN \
+    static void unit_suite_setup(int argc, char **argv) { \
+        (void)argc; \
+        (void)argv;
+
+#define END_TEST_MAIN }
+
+#define DEF_RUNNER_MAIN \
+    int main(int argc, char **argv) { \
+        return unit_run_suites(argc, argv); \
+    }
+
+/*
+ * A reloading test runner loads test suites that are compiled into shared
+ * objects and runs them again whenever they are rebuilt. It needs USE_SPLIT=1
+ * and must be linked with -rdynamic, so that the suites can call the driver.
+ */
+#define DEF_RELOAD_MAIN \
+    int main(int argc, char **argv) { \
+        return unit_reload_suites(argc, argv); \
     }
 
+#ifdef UNIT_RUNNER
+#define UNIT_SUITE_MAIN
+#else
+#define UNIT_SUITE_MAIN DEF_RUNNER_MAIN
+#endif
+
 /******************************************************************************
  *  Print macros add a bunch of information to the print.
  *
  *  One may use unit_error() or unit_msg() in a test, but these are really
  *  intended to be used by the macros that define the testing functionality.
  */
-// forward declaration
-static inline void unit_print(const char *, int, const char *,
-                              const char *, const char *, ...);
 #define unit_pass(fmt, ...) \
     do { \
         test->pass ++; \
-        if(VERBOSE >= 2) { \
+        if(unit_verbose >= 2) { \
             unit_print(__func__, __LINE__, "PASS", suite_name, fmt, ##__VA_ARGS__);  \
         } \
     } while(0)
@@ -156,7 +457,7 @@ static inline void unit_print(const char *, int, const char *,
 #define unit_fail(fmt, ...) \
     do { \
         test->fail ++; \
-        if(VERBOSE >= 1) { \
+        if(unit_verbose >= 1) { \
             unit_print(__func__, __LINE__, "FAIL", suite_name, fmt, ##__VA_ARGS__); \
         } \
     } while(0)
@@ -169,30 +470,74 @@ static inline void unit_print(const char *, int, const char *,
 
 #define unit_msg(level, fmt, ...) \
     do { \
-        if(VERBOSE >= level) { \
+        if(unit_verbose >= level) { \
             unit_print(__func__, __LINE__, "MSG", suite_name, fmt, ##__VA_ARGS__);  \
         } \
     } while(0)
 
 /******************************************************************************
- *  Function definitions for test driver.
+ *  Data structures and functions of the test driver.
  *
- *  These are static to limit what the test has to link with.
+ *  The functions are defined in unit_tests.c. By default, that file is
+ *  included at the end of this one and everything is static to limit what the
+ *  test has to link with. When USE_SPLIT is 1, unit_tests.c is compiled once
+ *  on its own and linked with every test suite, so this header only holds the
+ *  declarations and macros.
  *
  *  None of these should be called directly. They are all referenced by the
  *  macros that implement the testing.
- *
  */
-static char *suite_name;
+#if USE_SPLIT == 1
+#define UNIT_FUNC
+#define UNIT_DATA
+#define UNIT_EXTERN extern
+#else
+#define UNIT_FUNC static inline
+#define UNIT_DATA static __attribute__((unused))
+#define UNIT_EXTERN static
+#endif
+
+typedef int (*param_parse_t)(const char*, size_t, void*);
+
+/*
+ *  Where the rows of a parameterized test come from, either a table or a file.
+ */
+typedef struct param_source {
+    size_t size;
+    const void *table;
+    size_t count;
+    const char *file;
+    param_parse_t parse;
+} param_source_t;
+
 typedef struct test_list {
     const char *name;
     void (*fptr)(struct test_list*);
+    void (*param_fptr)(struct test_list*, const void*);
+    param_source_t *param;
     int fail;
     int pass;
+    int selected;
+    int ran;
+    uint64_t rows;
+    uint64_t rows_failed;
+    void (*prop_fptr)(struct test_list*);
+    int cases;
+    uint64_t cases_run;
+    void (*fuzz_fptr)(struct test_list*, const uint8_t*, size_t);
+    uint64_t duration;
+    uint64_t expected;
+    unsigned int timeout;       // milliseconds, 0 for the default of the suite
+    uint64_t started;           // when a forked test was forked
+    void (*setup)(struct test_list*);
+    void (*teardown)(struct test_list*);
+    int snapshot;               // always forked after the suite setup
     struct test_list *next;
 } test_list_t;
 
 typedef void (*fptr_t)(test_list_t*);
+typedef void (*param_fptr_t)(test_list_t*, const void*);
+typedef void (*fuzz_fptr_t)(test_list_t*, const uint8_t*, size_t);
 
 typedef struct mock_list {
     const char *name;
@@ -200,202 +545,142 @@ typedef struct mock_list {
     struct mock_list *next;
 } mock_list_t;
 
-static mock_list_t mocks[MAX_MOCKS];
-static int mock_idx = 0;
-static mock_list_t stubs[MAX_STUBS];
-static int stub_idx = 0;
-static test_list_t tests[MAX_TESTS];
-static int test_idx = 0;
+typedef void (*setup_fptr_t)(int, char**);
+typedef void *(*fixture_setup_t)(void);
+typedef void (*fixture_teardown_t)(void*);
 
-static int total_errors = 0;
-static int total_fail = 0;
-static int total_pass = 0;
+typedef struct suite_list {
+    const char *name;
+    setup_fptr_t setup;
+    int verbose;
+    int isolation;
+    int memory;
+    unsigned int timeout;
+    int vfs;
+    int time;
+} suite_list_t;
+
+UNIT_EXTERN const char *suite_name;
+UNIT_EXTERN int unit_verbose;
+UNIT_EXTERN int total_errors;
+UNIT_EXTERN void *unit_fixture;
+UNIT_EXTERN uint64_t latency_injected;
+
+UNIT_FUNC void unit_register_suite(const char *name, setup_fptr_t setup,
+                                   int verbose, int isolation, int memory,
+                                   unsigned int timeout, int vfs, int time);
+UNIT_FUNC int unit_run_suites(int argc, char **argv);
+#if USE_SPLIT == 1
+UNIT_FUNC int unit_reload_suites(int argc, char **argv);
+#endif
+UNIT_FUNC void unit_add_test(fptr_t test, const char* name);
+UNIT_FUNC void unit_set_timeout(const char *name, unsigned int ms);
+UNIT_FUNC void unit_add_suite_setup(fixture_setup_t setup);
+UNIT_FUNC void unit_add_suite_teardown(fixture_teardown_t teardown);
+UNIT_FUNC void unit_add_setup(fptr_t setup);
+UNIT_FUNC void unit_add_teardown(fptr_t teardown);
+UNIT_FUNC void unit_set_snapshot(const char *name);
+UNIT_FUNC void *unit_mutable_fixture(test_list_t *test);
+UNIT_FUNC void unit_add_param_test(param_fptr_t test, const char *name, size_t size,
+                                   const void *table, size_t count,
+                                   const char *file, param_parse_t parse);
+UNIT_FUNC void unit_add_property(fptr_t test, const char *name, int cases);
+UNIT_FUNC int64_t unit_gen_int(int64_t lo, int64_t hi);
+UNIT_FUNC void *unit_gen_buffer(size_t min, size_t max, size_t *len);
+UNIT_FUNC int *unit_gen_ops(int n, size_t min, size_t max, size_t *len);
+UNIT_FUNC void unit_add_fuzz(fuzz_fptr_t test, const char *name);
+UNIT_FUNC size_t unit_buffer_mismatch(const void *e, const void *g, size_t size);
+UNIT_FUNC size_t unit_array_mismatch_f32(const float *e, const float *g, size_t n,
+                                         float tol, uint32_t ulps);
+UNIT_FUNC size_t unit_array_mismatch_f64(const double *e, const double *g, size_t n,
+                                         double tol, uint64_t ulps);
+UNIT_FUNC void unit_diff_hex(const void *e, const void *g, size_t size);
+UNIT_FUNC int unit_diff_wanted(const char *e, const char *g);
+UNIT_FUNC void unit_diff_lines(const char *e, const char *g);
+UNIT_FUNC const char *unit_golden_check(const void *buf, size_t len, const char *path);
+UNIT_FUNC void unit_golden_diff(const void *buf, size_t len);
+UNIT_FUNC void unit_track_stub(const char* name);
+UNIT_FUNC void unit_track_mock(const char* name);
+UNIT_FUNC void unit_mock_entered(const char* name);
+UNIT_FUNC void unit_stub_entered(const char* name);
+UNIT_FUNC int unit_set_latency(const char *name, int dist, uint64_t ns, uint64_t max,
+                               uint64_t seed);
+UNIT_FUNC void unit_clear_latency(const char *name);
+UNIT_FUNC int unit_check_mock_entered(const char* name);
+UNIT_FUNC int unit_check_stub_entered(const char* name);
+UNIT_FUNC void unit_print(const char *, int, const char *,
+                          const char *, const char *, ...);
 
 #if USE_MEMORY==1
-static unsigned int memory_pool = 0;
-static unsigned int total_memory_allocated = 0;
-
-int malloc_count = 0;
-int calloc_count = 0;
-int free_count = 0;
-int realloc_count = 0;
-int strdup_count = 0;
-
-void reset_memory_stats(void) {
-    malloc_count = 0;
-    calloc_count = 0;
-    free_count = 0;
-    realloc_count = 0;
-    strdup_count = 0;
-}
-
+UNIT_EXTERN unsigned int memory_pool;
+UNIT_EXTERN unsigned int total_memory_allocated;
+UNIT_EXTERN unsigned int test_memory_allocated;
+UNIT_EXTERN int malloc_count;
+UNIT_EXTERN int calloc_count;
+UNIT_EXTERN int free_count;
+UNIT_EXTERN int realloc_count;
+UNIT_EXTERN int strdup_count;
+
+UNIT_FUNC void *unit_malloc(size_t size);
+UNIT_FUNC void *unit_calloc(size_t num, size_t size);
+UNIT_FUNC void unit_free(void *ptr);
+UNIT_FUNC void *unit_realloc(void *ptr, size_t size);
+UNIT_FUNC char *unit_strdup(const char *str);
 #endif
 
-static inline void show_mocks_and_stubs(void) {
-
-    printf("\nMocks:\n");
-    for(int i = 0; mocks[i].name != NULL; i++)
-        printf("   %s: %d\n", mocks[i].name, mocks[i].count);
-
-    printf("Stubs:\n");
-    for(int i = 0; stubs[i].name != NULL; i++)
-        printf("   %s: %d\n", stubs[i].name, stubs[i].count);
-}
-
-static inline void reset_mocks_and_stubs(void) {
-
-    for(int i = 0; mocks[i].name != NULL; i++)
-        mocks[i].count = 0;
-
-    for(int i = 0; stubs[i].name != NULL; i++)
-        stubs[i].count = 0;
-}
-
-static void exit_routine(void) {
-
-    printf("\n%s: test funcs: %d, pass: %d, fail: %d, errors: %d\n",
-           suite_name, test_idx, total_pass, total_fail, total_errors);
-    printf("     tests: %d, stubs: %d, mocks: %d\n", test_idx, stub_idx, mock_idx);
-
-#if USE_MEMORY==1
-        printf("     memory allocated: %u, memory still in use: %u\n",
-               total_memory_allocated, memory_pool);
+#if FILE_IO_USED==1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+UNIT_EXTERN int fopen_count;
+UNIT_EXTERN int fread_count;
+UNIT_EXTERN int fwrite_count;
+UNIT_EXTERN int fclose_count;
+UNIT_EXTERN int open_count;
+UNIT_EXTERN int read_count;
+UNIT_EXTERN int write_count;
+UNIT_EXTERN int close_count;
+UNIT_EXTERN int lseek_count;
+UNIT_EXTERN int unlink_count;
+UNIT_EXTERN int mmap_count;
+UNIT_EXTERN int munmap_count;
+UNIT_EXTERN uint64_t io_bytes_read;
+UNIT_EXTERN uint64_t io_bytes_written;
+UNIT_EXTERN int io_files_open;
+
+UNIT_FUNC FILE *unit_fopen(const char *path, const char *mode);
+UNIT_FUNC size_t unit_fread(void *ptr, size_t size, size_t nmemb, FILE *fp);
+UNIT_FUNC size_t unit_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *fp);
+UNIT_FUNC int unit_fclose(FILE *fp);
+UNIT_FUNC int unit_open(const char *path, int flags, ...);
+UNIT_FUNC ssize_t unit_read(int fd, void *buf, size_t count);
+UNIT_FUNC ssize_t unit_write(int fd, const void *buf, size_t count);
+UNIT_FUNC int unit_close(int fd);
+UNIT_FUNC off_t unit_lseek(int fd, off_t off, int whence);
+UNIT_FUNC int unit_unlink(const char *path);
+UNIT_FUNC void *unit_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
+UNIT_FUNC int unit_munmap(void *addr, size_t len);
+UNIT_FUNC const void *unit_vfs_data(const char *path, size_t *size);
+UNIT_FUNC void unit_vfs_faults(size_t short_read, size_t short_write, size_t space);
 #endif
 
-    if(VERBOSE > 3) {
-        show_mocks_and_stubs();
-    }
-}
+#if USE_TIME==1
+#include <time.h>
+#include <unistd.h>
 
-static inline int unit_run_all_tests(void) {
+UNIT_EXTERN uint64_t unit_clock;
+UNIT_EXTERN uint64_t unit_clock_step;
+UNIT_EXTERN uint64_t time_slept;
+UNIT_EXTERN int sleep_count;
 
-#if USE_MEMORY==1
-    total_memory_allocated = 0;
-#endif
-
-    for(int i = 0; tests[i].fptr != NULL; i++) {
-        reset_mocks_and_stubs();
-#if USE_MEMORY == 1
-        reset_memory_stats();
-        memory_pool = 0;
-#endif
-        (*tests[i].fptr)(&tests[i]);
-        total_pass += tests[i].pass;
-        total_fail += tests[i].fail;
-        if(VERBOSE > 0) {
-            printf("%d. %s: pass: %d, fail: %d\n",
-                   i+1, tests[i].name, tests[i].pass, tests[i].fail);
-        }
-    }
-    return total_fail;
-}
-
-static inline void unit_add_test(fptr_t test, const char* name) {
-
-    unit_msg(5, "add test name = \"%s\"", name);
-    tests[test_idx].fptr = test;
-    tests[test_idx].name = name;
-    test_idx ++;
-}
-
-static inline void unit_track_stub(const char* name) {
-
-    // only add a given name one time
-    for(int i = 0; stubs[i].name != NULL; i++) {
-        if(stubs[i].name == name) {
-            stubs[i].count = 0;
-            unit_msg(5, "stub name \"%s\" is already being tracked", name);
-            return;
-        }
-    }
-    unit_msg(5, "tracking stub name = \"%s\"", name);
-    stubs[stub_idx].name = name;
-    stub_idx ++;
-}
-
-static inline void unit_track_mock(const char* name) {
-
-    // only add a given name one time
-    for(int i = 0; mocks[i].name != NULL; i++) {
-        if(mocks[i].name == name) {
-            mocks[i].count = 0;
-            unit_msg(5, "mock name \"%s\" is already being tracked", name);
-            return;
-        }
-    }
-    unit_msg(5, "tracking mock name = \"%s\"", name);
-    mocks[mock_idx].name = name;
-    mock_idx ++;
-}
-
-// These function update a global data structure that can be polled then the
-// test has finished running.
-static inline void unit_mock_entered(const char* name) {
-
-    unit_msg(5, "mock name = \"%s\"", name);
-    for(int i = 0; mocks[i].name != NULL; i++)
-        if(!strcmp(mocks[i].name, name)) {
-            unit_msg(5, "mock found");
-            mocks[i].count++;
-            return;
-        }
-    unit_msg(5, "mock not found");
-}
-
-static inline void unit_stub_entered(const char* name) {
-
-    unit_msg(5, "stub name = \"%s\"", name);
-    for(int i = 0; stubs[i].name != NULL; i++)
-        if(!strcmp(stubs[i].name, name)) {
-            unit_msg(5, "stub found");
-            stubs[i].count++;
-            return;
-        }
-    unit_msg(5, "stub not found");
-    // else simply do nothing if the stub is not in the list
-}
-
-static inline int unit_check_mock_entered(const char* name) {
-
-    unit_msg(5, "mock name = \"%s\"", name);
-    for(int i = 0; mocks[i].name != NULL; i++)
-        if(!strcmp(mocks[i].name, name)) {
-            unit_msg(5, "mock found");
-            return mocks[i].count;
-        }
-
-    unit_msg(5, "mock not found");
-    return 0;
-}
-
-static inline int unit_check_stub_entered(const char* name) {
-
-    unit_msg(5, "stub name = \"%s\"", name);
-    for(int i = 0; stubs[i].name != NULL; i++)
-        if(!strcmp(stubs[i].name, name)) {
-            unit_msg(5, "stub found");
-            return stubs[i].count;
-        }
-    unit_msg(5, "stub not found");
-    return 0;
-}
-
-// Generic print routine
-static inline void unit_print(const char *preamble,
-                              //const char *file_name,
-                              int line_no,
-                              const char *func_name,
-                              const char *sname,
-                              const char *fmt, ...) {
-    va_list args;
-
-    //printf("%s: %s: %s: %d: %s: ", preamble, file_name, func_name, line_no, sname);
-    printf("%s: %d: %s: %s: ", preamble, line_no, func_name, sname);
-    va_start(args, fmt);
-    vprintf(fmt, args);
-    va_end(args);
-    printf("\n");
-}
+UNIT_FUNC int unit_clock_gettime(clockid_t id, struct timespec *ts);
+UNIT_FUNC time_t unit_time(time_t *t);
+UNIT_FUNC int unit_nanosleep(const struct timespec *req, struct timespec *rem);
+UNIT_FUNC int unit_usleep(useconds_t usec);
+UNIT_FUNC unsigned int unit_sleep(unsigned int seconds);
+#endif
 
 /******************************************************************************
  * Assert macros
@@ -496,9 +781,17 @@ static inline void unit_print(const char *preamble,
         } \
     } while(0)
 
+/*
+ *  Strings that have more than one line, or are long, are diffed when they
+ *  are not equal.
+ */
 #define assert_string_equal(e, g) \
     do { \
-        if(strcmp(e, g)) { \
+        if(strcmp(e, g) && unit_diff_wanted(e, g)) { \
+            unit_fail("assert string equal, the strings differ"); \
+            unit_diff_lines(e, g); \
+        } \
+        else if(strcmp(e, g)) { \
             unit_fail("assert string equal expected \"%s\" but got \"%s\"", e, g); \
         } \
         else { \
@@ -586,12 +879,15 @@ static inline void unit_print(const char *preamble,
  */
 #define assert_buffer_equal(p1, p2, s) \
     do { \
-        int val; \
-        if(0 != (val = memcmp((p1), (p2), (s)))) { \
-            unit_fail("assert buffer equal returns %d", val); \
+        size_t off = unit_buffer_mismatch((p1), (p2), (s)); \
+        if(off < (size_t)(s)) { \
+            unit_fail("assert buffer equal at byte %zu of %zu expected 0x%02x but got 0x%02x", \
+                      off, (size_t)(s), ((const unsigned char*)(p1))[off], \
+                      ((const unsigned char*)(p2))[off]); \
+            unit_diff_hex((p1), (p2), (s)); \
         } \
         else { \
-            unit_pass("assert buffer equal returns %d", val); \
+            unit_pass("assert buffer equal"); \
         } \
     } while(0)
 
@@ -606,81 +902,83 @@ static inline void unit_print(const char *preamble,
         } \
     } while(0)
 
-/******************************************************************************
- * Memory replacement functions. These track memory used and cause a report to
- * be printed at the end of the test suite. They are simply wrappers for the
- * default memory allocation functions that track a little extra data.
+/*
+ *  "e" is the expected array
+ *  "g" is the test array
+ *  "n" is the number of elements in them
+ *  "t" is how far apart two elements can be and still be equal
+ *  "u" is how many ULPs apart two elements can be and still be equal
+ *
+ *  The arrays are compared with vectorized kernels and the first element that
+ *  does not match is reported. Floating point elements also match when they
+ *  are equal as values (0.0 and -0.0) or both NaN.
  */
-#if USE_MEMORY==1
+#define unit_assert_array(what, type, ptype, fmt, idx, e, g, n) \
+    do { \
+        size_t _n = (size_t)(n); \
+        size_t _i = (idx); \
+        if(_i < _n) { \
+            unit_fail("assert array " what " at index %zu of %zu expected " fmt " but got " fmt, \
+                      _i, _n, (ptype)((const type*)(e))[_i], (ptype)((const type*)(g))[_i]); \
+        } \
+        else { \
+            unit_pass("assert array " what); \
+        } \
+    } while(0)
 
-void *(*old_malloc)(size_t) = malloc;
-#define malloc unit_malloc
-void *unit_malloc(size_t size) {
-    malloc_count ++;
-    unit_msg(5, "enter unit_malloc: size = %lu", size);
-    void *buf = old_malloc(size+sizeof(size_t));
-    *(size_t*)buf = size;
-    memory_pool += size;
-    total_memory_allocated += size;
-    unit_msg(5, "leave unit_malloc returning: %p", buf+sizeof(size_t));
-    return buf+sizeof(size_t);
-}
-
-void *(*old_calloc)(size_t, size_t) = calloc;
-#define calloc unit_calloc
-void *unit_calloc(size_t num, size_t size) {
-    calloc_count++;
-    unit_msg(5, "enter unit_calloc: num = %lu, size = %lu", num, size);
-    size_t bsize = num * size;
-    size_t asize = bsize+sizeof(size_t);
-    void *buf = old_malloc(asize);
-    memset(buf, 0, asize);
-    *(size_t*)buf = size;
-    memory_pool += size;
-    total_memory_allocated += size;
-    unit_msg(5, "leave unit_calloc returning: %p", buf+sizeof(size_t));
-    return buf+sizeof(size_t);
-}
-
-void (*old_free)(void*) = free;
-#define free unit_free
-void unit_free(void *ptr) {
-    free_count ++;
-    unit_msg(5, "enter unit_free: ptr = %p", ptr);
-    size_t *nptr = (size_t*)(ptr-sizeof(size_t));
-    size_t size = *nptr;
-    old_free(nptr);
-    memory_pool -= size;
-    unit_msg(5, "leave unit_free");
-}
-
-void *(*old_realloc)(void*, size_t size) = realloc;
-#define realloc unit_realloc
-void *unit_realloc(void *ptr, size_t size) {
-    realloc_count ++;
-    unit_msg(5, "enter unit_realloc: ptr = %p, size = %lu", ptr, size);
-    void *buf = ptr-sizeof(size_t);
-    size_t old_size = *(size_t*)buf;
-    buf = old_realloc(buf, size+sizeof(size_t));
-    memory_pool += size - old_size; // could be negative
-    unit_msg(5, "leave unit_realloc returning: %p", buf+sizeof(size_t));
-    return buf+sizeof(size_t);
-}
-
-char *(*old_strdup)(const char*) = strdup;
-#define strdup unit_strdup
-char *unit_strdup(const char *str) {
-    strdup_count ++;
-    unit_msg(5, "enter unit_strdup: ptr = %p", (void*)str);
-    size_t len = strlen(str)+1;
-    void *buf = old_malloc(len+sizeof(size_t));
-    char *retbuf = buf+sizeof(size_t);
-    strcpy(retbuf, str);
-    *(size_t*)buf = len;
-    memory_pool += len;
-    unit_msg(5, "leave unit_strdup returning: %p", (void*)retbuf);
-    return retbuf;
-}
+#define assert_array_equal_i32(e, g, n) \
+    unit_assert_array("equal i32", int32_t, int, "%d", \
+                      unit_buffer_mismatch((e), (g), (size_t)(n)*4) / 4, e, g, n)
+
+#define assert_array_equal_i64(e, g, n) \
+    unit_assert_array("equal i64", int64_t, long long, "%lld", \
+                      unit_buffer_mismatch((e), (g), (size_t)(n)*8) / 8, e, g, n)
+
+#define assert_array_equal_f32(e, g, n) \
+    unit_assert_array("equal f32", float, float, "%.9g", \
+                      unit_array_mismatch_f32((e), (g), (n), 0, 0), e, g, n)
+
+#define assert_array_near_f32(e, g, n, t) \
+    unit_assert_array("near f32", float, float, "%.9g", \
+                      unit_array_mismatch_f32((e), (g), (n), (t), 0), e, g, n)
+
+#define assert_array_ulps_f32(e, g, n, u) \
+    unit_assert_array("ulps f32", float, float, "%.9g", \
+                      unit_array_mismatch_f32((e), (g), (n), 0, (u)), e, g, n)
+
+#define assert_array_equal_f64(e, g, n) \
+    unit_assert_array("equal f64", double, double, "%.17g", \
+                      unit_array_mismatch_f64((e), (g), (n), 0, 0), e, g, n)
+
+#define assert_array_near_f64(e, g, n, t) \
+    unit_assert_array("near f64", double, double, "%.17g", \
+                      unit_array_mismatch_f64((e), (g), (n), (t), 0), e, g, n)
+
+#define assert_array_ulps_f64(e, g, n, u) \
+    unit_assert_array("ulps f64", double, double, "%.17g", \
+                      unit_array_mismatch_f64((e), (g), (n), 0, (u)), e, g, n)
+
+/*
+ *  "b" is the output of the test
+ *  "s" is its size
+ *  "path" is the golden file that holds the output it should have
+ *
+ *  When they differ, the output is written to the path with ".actual" added
+ *  and a diff is printed. Run with --update-golden to write the golden files.
+ */
+#define assert_matches_golden(b, s, path) \
+    do { \
+        const char *msg = unit_golden_check((b), (s), (path)); \
+        if(msg != NULL) { \
+            unit_fail("assert matches golden \"%s\" %s", (path), msg); \
+            unit_golden_diff((b), (s)); \
+        } \
+        else { \
+            unit_pass("assert matches golden \"%s\"", (path)); \
+        } \
+    } while(0)
+
+#if USE_MEMORY==1
 
 /******************************************************************************
  *  These assert macros for the memory allocation wrappers. These are used to
@@ -717,10 +1015,15 @@ char *unit_strdup(const char *str) {
         } \
     } while(0)
 
+/*
+ *  The total counts the bytes that the test itself has allocated, whether or
+ *  not they were freed again. It starts at 0 for every test, so it does not
+ *  depend on the tests that ran before it.
+ */
 #define assert_memory_total_size(n) \
     do { \
-        if((n) != total_memory_allocated) { \
-            unit_fail("assert memory total size. expected %u but got %u", (n), total_memory_allocated); \
+        if((n) != test_memory_allocated) { \
+            unit_fail("assert memory total size. expected %u but got %u", (n), test_memory_allocated); \
         } \
         else { \
             unit_pass("assert memory total size"); \
@@ -729,7 +1032,7 @@ char *unit_strdup(const char *str) {
 
 #define assert_memory_total_not_zero() \
     do { \
-        if((n) != total_memory_allocated) { \
+        if(0 == test_memory_allocated) { \
             unit_fail("assert memory total is not zero."); \
         } \
         else { \
@@ -737,9 +1040,9 @@ char *unit_strdup(const char *str) {
         } \
     } while(0)
 
-#define assert_memory_total_zero(n) \
+#define assert_memory_total_zero() \
     do { \
-        if((n) != total_memory_allocated) { \
+        if(0 != test_memory_allocated) { \
             unit_fail("assert memory total is zero."); \
         } \
         else { \
@@ -931,6 +1234,274 @@ char *unit_strdup(const char *str) {
 
 #endif /* USE_MEMORY */
 
+#if FILE_IO_USED==1
+
+/******************************************************************************
+ *  These assert macros are for the file IO wrappers. The calls and the bytes
+ *  that were read and written are counted for every test, so a test can lock
+ *  in how the code under test batches its IO. A call to fread() or fwrite()
+ *  is counted as one call, even though the stream may not make a system call
+ *  for it.
+ */
+#define assert_bytes_read(n) \
+    do { \
+        if((uint64_t)(n) != io_bytes_read) { \
+            unit_fail("assert bytes read. expected %llu but got %llu", \
+                      (unsigned long long)(n), (unsigned long long)io_bytes_read); \
+        } \
+        else { \
+            unit_pass("assert bytes read"); \
+        } \
+    } while(0)
+
+#define assert_bytes_written(n) \
+    do { \
+        if((uint64_t)(n) != io_bytes_written) { \
+            unit_fail("assert bytes written. expected %llu but got %llu", \
+                      (unsigned long long)(n), (unsigned long long)io_bytes_written); \
+        } \
+        else { \
+            unit_pass("assert bytes written"); \
+        } \
+    } while(0)
+
+#define assert_max_read_calls(n) \
+    do { \
+        if(read_count + fread_count > (n)) { \
+            unit_fail("assert max read calls. expected at most %d but got %d", \
+                      (n), read_count + fread_count); \
+        } \
+        else { \
+            unit_pass("assert max read calls"); \
+        } \
+    } while(0)
+
+#define assert_max_write_calls(n) \
+    do { \
+        if(write_count + fwrite_count > (n)) { \
+            unit_fail("assert max write calls. expected at most %d but got %d", \
+                      (n), write_count + fwrite_count); \
+        } \
+        else { \
+            unit_pass("assert max write calls"); \
+        } \
+    } while(0)
+
+/*
+ *  "f" is one of fopen, fread, fwrite, fclose, open, read, write, close,
+ *  lseek, unlink, mmap or munmap.
+ */
+#define assert_io_entered_count(f, v) \
+    do { \
+        if(f##_count != (v)) { \
+            unit_fail("assert " #f " entered count expected %d but got %d.", (v), f##_count); \
+        } \
+        else { \
+            unit_pass("assert " #f " entered count."); \
+        } \
+    } while(0)
+
+#define assert_files_closed() \
+    do { \
+        if(io_files_open != 0) { \
+            unit_fail("assert files closed. %d files are still open", io_files_open); \
+        } \
+        else { \
+            unit_pass("assert files closed"); \
+        } \
+    } while(0)
+
+/******************************************************************************
+ *  These are for the filesystem in memory (USE_VFS). The faults last until
+ *  the end of the test. A read or a write of more than the short read or the
+ *  short write size only moves that many bytes, and once the files hold
+ *  "space" bytes in all, a write that would make a file larger fails with
+ *  ENOSPC. A size of 0 turns the fault off.
+ */
+#define set_vfs_short_read(n) unit_vfs_faults((n), (size_t)-1, (size_t)-1)
+#define set_vfs_short_write(n) unit_vfs_faults((size_t)-1, (n), (size_t)-1)
+#define set_vfs_space(n) unit_vfs_faults((size_t)-1, (size_t)-1, (n))
+
+#define assert_vfs_file_size(path, n) \
+    do { \
+        size_t size; \
+        if(unit_vfs_data((path), &size) == NULL) { \
+            unit_fail("assert vfs file size. %s does not exist", (path)); \
+        } \
+        else if(size != (size_t)(n)) { \
+            unit_fail("assert vfs file size. expected %zu but got %zu", (size_t)(n), size); \
+        } \
+        else { \
+            unit_pass("assert vfs file size"); \
+        } \
+    } while(0)
+
+/*
+ *  "b" is the expected data and "s" is its size
+ */
+#define assert_vfs_file_equal(path, b, s) \
+    do { \
+        size_t size; \
+        const unsigned char *data = unit_vfs_data((path), &size); \
+        if(data == NULL) { \
+            unit_fail("assert vfs file equal. %s does not exist", (path)); \
+        } \
+        else if(size != (size_t)(s)) { \
+            unit_fail("assert vfs file equal. expected %zu bytes but got %zu", (size_t)(s), size); \
+        } \
+        else { \
+            size_t off = unit_buffer_mismatch((b), data, (s)); \
+            if(off < (size_t)(s)) { \
+                unit_fail("assert vfs file equal at byte %zu of %zu expected 0x%02x but got 0x%02x", \
+                          off, (size_t)(s), ((const unsigned char*)(b))[off], data[off]); \
+                unit_diff_hex((b), data, (s)); \
+            } \
+            else { \
+                unit_pass("assert vfs file equal"); \
+            } \
+        } \
+    } while(0)
+
+#else
+
+#define assert_bytes_read(n) unit_error("Must enable FILE_IO_USED to use file IO assertions.")
+#define assert_bytes_written(n) unit_error("Must enable FILE_IO_USED to use file IO assertions.")
+#define assert_max_read_calls(n) unit_error("Must enable FILE_IO_USED to use file IO assertions.")
+#define assert_max_write_calls(n) unit_error("Must enable FILE_IO_USED to use file IO assertions.")
+#define assert_io_entered_count(f, v) unit_error("Must enable FILE_IO_USED to use file IO assertions.")
+#define assert_files_closed() unit_error("Must enable FILE_IO_USED to use file IO assertions.")
+#define set_vfs_short_read(n) unit_error("Must enable FILE_IO_USED to use the filesystem in memory.")
+#define set_vfs_short_write(n) unit_error("Must enable FILE_IO_USED to use the filesystem in memory.")
+#define set_vfs_space(n) unit_error("Must enable FILE_IO_USED to use the filesystem in memory.")
+#define assert_vfs_file_size(path, n) unit_error("Must enable FILE_IO_USED to use the filesystem in memory.")
+#define assert_vfs_file_equal(path, b, s) unit_error("Must enable FILE_IO_USED to use the filesystem in memory.")
+
+#endif /* FILE_IO_USED */
+
+#if USE_TIME==1
+
+/******************************************************************************
+ *  The virtual clock starts at 0 for every test, and for every case of a
+ *  property or input of a fuzz target. CLOCK_REALTIME and time() read it as a
+ *  time after UNIT_TIME_EPOCH. It only moves forward when the test advances
+ *  it, when the code under test sleeps, or by the step that is added every
+ *  time it is read, for code that waits for a time to pass without sleeping.
+ *  These macros move it and check how long the code under test slept.
+ */
+#define advance_clock(ns) do { unit_clock += (uint64_t)(ns); } while(0)
+#define set_clock(ns) do { unit_clock = (uint64_t)(ns); } while(0)
+#define set_clock_step(ns) do { unit_clock_step = (uint64_t)(ns); } while(0)
+
+#define assert_time_slept(ns) \
+    do { \
+        if((uint64_t)(ns) != time_slept) { \
+            unit_fail("assert time slept. expected %llu ns but got %llu ns", \
+                      (unsigned long long)(ns), (unsigned long long)time_slept); \
+        } \
+        else { \
+            unit_pass("assert time slept"); \
+        } \
+    } while(0)
+
+#define assert_sleep_entered() \
+    do { \
+        if(sleep_count == 0) { \
+            unit_fail("assert sleep entered."); \
+        } \
+        else { \
+            unit_pass("assert sleep entered."); \
+        } \
+    } while(0)
+
+#define assert_sleep_not_entered() \
+    do { \
+        if(sleep_count != 0) { \
+            unit_fail("assert sleep not entered."); \
+        } \
+        else { \
+            unit_pass("assert sleep not entered."); \
+        } \
+    } while(0)
+
+#define assert_sleep_entered_count(v) \
+    do { \
+        if(sleep_count != v) { \
+            unit_fail("assert sleep entered count expected %d but got %d.", v, sleep_count); \
+        } \
+        else { \
+            unit_pass("assert sleep entered count."); \
+        } \
+    } while(0)
+
+#else
+
+#define advance_clock(ns) unit_error("Must enable USE_TIME to use the virtual clock.")
+#define set_clock(ns) unit_error("Must enable USE_TIME to use the virtual clock.")
+#define set_clock_step(ns) unit_error("Must enable USE_TIME to use the virtual clock.")
+#define assert_time_slept(ns) unit_error("Must enable USE_TIME to use time assertions.")
+#define assert_sleep_entered() unit_error("Must enable USE_TIME to use time assertions.")
+#define assert_sleep_not_entered() unit_error("Must enable USE_TIME to use time assertions.")
+#define assert_sleep_entered_count(v) unit_error("Must enable USE_TIME to use time assertions.")
+
+#endif /* USE_TIME */
+
+/******************************************************************************
+ *  Latency injection. "n" is the name of a mock, a stub or a replacement
+ *  function, such as malloc or write, and every call to it takes the latency
+ *  until the end of the test. The latency passes on the virtual clock when
+ *  USE_TIME is on, and is burned on the real clock otherwise. The uniform and
+ *  the heavy tailed latencies are drawn from the seed, so they are the same
+ *  every run. The heavy tail is a Pareto distribution: half of the calls take
+ *  at least 2 * ns, one in a thousand at least 1000 * ns, up to max.
+ */
+#define UNIT_LATENCY_FIXED      0
+#define UNIT_LATENCY_UNIFORM    1
+#define UNIT_LATENCY_PARETO     2
+
+// a test that cannot have its latency fails, rather than run without it
+#define unit_set_latency_or_fail(n, dist, ns, max, seed) \
+    do { \
+        if(0 != unit_set_latency(n, dist, ns, max, seed)) { \
+            unit_fail("set latency of \"%s\"", n); \
+        } \
+    } while(0)
+
+#define set_latency_fixed(n, ns) \
+    unit_set_latency_or_fail(#n, UNIT_LATENCY_FIXED, (ns), (ns), 0)
+#define set_latency_uniform(n, lo, hi, seed) \
+    unit_set_latency_or_fail(#n, UNIT_LATENCY_UNIFORM, (lo), (hi), (seed))
+#define set_latency_pareto(n, ns, max, seed) \
+    unit_set_latency_or_fail(#n, UNIT_LATENCY_PARETO, (ns), (max), (seed))
+#define clear_latency(n) unit_clear_latency(#n)
+
+#define assert_latency_injected(ns) \
+    do { \
+        if((uint64_t)(ns) != latency_injected) { \
+            unit_fail("assert latency injected. expected %llu but got %llu", \
+                      (unsigned long long)(ns), (unsigned long long)latency_injected); \
+        } \
+        else { \
+            unit_pass("assert latency injected"); \
+        } \
+    } while(0)
+
+/*
+ *  "h" is a unit_hist_t of latencies and "p" is a percentile, such as 99.9.
+ *  The percentile is the top of its bucket, so it can be up to 1 part in 64
+ *  more than the latency that was recorded.
+ */
+#define assert_percentile_below(h, p, ns) \
+    do { \
+        uint64_t val = unit_hist_percentile((h), (p)); \
+        if(val >= (uint64_t)(ns)) { \
+            unit_fail("assert percentile below. p%g is %llu ns, expected below %llu ns", \
+                      (double)(p), (unsigned long long)val, (unsigned long long)(ns)); \
+        } \
+        else { \
+            unit_pass("assert percentile below"); \
+        } \
+    } while(0)
+
 #if USE_CAPTURE == 1
 /*
  *  Capture is implemented with setjmp.h. They are used for things like exiting
@@ -938,7 +1509,7 @@ char *unit_strdup(const char *str) {
  *  to exit upon. For example, the fatal_error function in the examples.
  */
 #include <setjmp.h>
-jmp_buf unit_jbuf;
+UNIT_EXTERN jmp_buf unit_jbuf;
 #define CAPTURE do { if(0 == setjmp(unit_jbuf)) {
 #define END_CAPTURE }} while(0);
 #define RAISE() do { longjmp(unit_jbuf, 1); } while(0)
@@ -948,4 +1519,52 @@ jmp_buf unit_jbuf;
 #define RAISE() unit_error("Must enable USE_CAPTURE to use RAISE macro.")
 #endif
 
+#if USE_SPLIT == 0
+#include "unit_tests.c"
+#endif
+
+/******************************************************************************
+ *  Send the memory allocation calls in the code that follows, which is the test
+ *  suite and the module under test, to the memory replacement functions.
+ */
+#if USE_MEMORY==1 && !defined(UNIT_TESTS_IMPLEMENTATION)
+#define malloc unit_malloc
+#define calloc unit_calloc
+#define free unit_free
+#define realloc unit_realloc
+#define strdup unit_strdup
+#endif
+
+/*
+ *  Send the file IO calls to the file IO replacement functions. Like the
+ *  clock, only calls are replaced, but a call through a member that has one
+ *  of these names, such as ops->read(fd), is replaced as well.
+ */
+#if FILE_IO_USED==1 && !defined(UNIT_TESTS_IMPLEMENTATION)
+#define fopen(path, mode) unit_fopen((path), (mode))
+#define fread(ptr, size, nmemb, fp) unit_fread((ptr), (size), (nmemb), (fp))
+#define fwrite(ptr, size, nmemb, fp) unit_fwrite((ptr), (size), (nmemb), (fp))
+#define fclose(fp) unit_fclose(fp)
+#define open(...) unit_open(__VA_ARGS__)
+#define read(fd, buf, count) unit_read((fd), (buf), (count))
+#define write(fd, buf, count) unit_write((fd), (buf), (count))
+#define close(fd) unit_close(fd)
+#define lseek(fd, off, whence) unit_lseek((fd), (off), (whence))
+#define unlink(path) unit_unlink(path)
+#define mmap(addr, len, prot, flags, fd, off) unit_mmap((addr), (len), (prot), (flags), (fd), (off))
+#define munmap(addr, len) unit_munmap((addr), (len))
+#endif
+
+/*
+ *  Send the clock and sleep calls to the virtual clock. Only calls are
+ *  replaced, so a variable or a member called time is left alone.
+ */
+#if USE_TIME==1 && !defined(UNIT_TESTS_IMPLEMENTATION)
+#define clock_gettime(id, ts) unit_clock_gettime((id), (ts))
+#define time(t) unit_time(t)
+#define nanosleep(req, rem) unit_nanosleep((req), (rem))
+#define usleep(usec) unit_usleep(usec)
+#define sleep(seconds) unit_sleep(seconds)
+#endif
+
 #endif /* _UNIT_TESTS_H_ */
@@ -0,0 +1,356 @@
+/*
+ *  Watch mode. This program watches the source directories with inotify and,
+ *  when a file in them changes, rebuilds and reruns only the test suites that
+ *  depend on it.
+ *
+ *  The dependencies come from the files that the compiler writes with -MMD,
+ *  one for every test suite and every object file, in the dependency
+ *  directory. The Makefile adds the object files that a test suite links with
+ *  to the dependencies of the suite. A change is followed through the object
+ *  files to the test suites, which are then made in one parallel run of make.
+ *  The dependency files are read again after every build, since a change can
+ *  add or remove an include.
+ *
+ *  The changes are collected until there have been none for a short time, so
+ *  that saving several files, or an editor that writes a file in several
+ *  steps, causes one build.
+ *
+ *  usage: unit_watch [options] dir ...
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+
+#ifndef MAX_RULES
+#define MAX_RULES 1000
+#endif
+
+#ifndef MAX_DIRS
+#define MAX_DIRS 20
+#endif
+
+typedef struct {
+    char target[NAME_MAX+1];    // as make knows it
+    char target_path[PATH_MAX];
+    char prereq_path[PATH_MAX];
+    int goal;                   // the target is a test suite
+} rule_t;
+
+static rule_t rules[MAX_RULES];
+static int num_rules = 0;
+
+static char dirs[MAX_DIRS][PATH_MAX];
+static int dir_wd[MAX_DIRS];
+static int num_dirs = 0;
+
+static char changed[MAX_RULES][PATH_MAX];
+static int num_changed = 0;
+
+static const char *dep_dir = "./.test_deps/";
+static const char *make_cmd = "make";
+static int jobs = 1;
+static int delay = 100;
+
+/*
+ *  Turn a path into an absolute one, so that a path from a dependency file
+ *  and a path from an event compare equal. A file that does not exist, such
+ *  as an object file before it is built, is made absolute without resolving
+ *  any links.
+ */
+static void watch_abspath(const char *path, char *out) {
+
+    char cwd[PATH_MAX];
+
+    if(realpath(path, out) != NULL)
+        return;
+
+    if(path[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL)
+        snprintf(out, PATH_MAX, "%s", path);
+    else {
+        while(!strncmp(path, "./", 2))
+            path += 2;
+        if(snprintf(out, PATH_MAX, "%s/%s", cwd, path) >= PATH_MAX)
+            snprintf(out, PATH_MAX, "%s", path);
+    }
+}
+
+static void watch_add_rule(const char *target, const char *prereq, int goal) {
+
+    if(num_rules >= MAX_RULES) {
+        printf("too many dependencies, increase MAX_RULES (%d)\n", MAX_RULES);
+        exit(2);
+    }
+
+    rule_t *rule = &rules[num_rules++];
+    snprintf(rule->target, sizeof(rule->target), "%s", target);
+    watch_abspath(target, rule->target_path);
+    watch_abspath(prereq, rule->prereq_path);
+    rule->goal = goal;
+}
+
+/*
+ *  Read one dependency file. A line continues on the next one when it ends
+ *  with a backslash. The rules without prerequisites that -MP adds are
+ *  skipped. Object files are not goals, they are only followed.
+ */
+static void watch_read_deps(const char *name) {
+
+    static char text[1024*64];
+    char path[PATH_MAX];
+    FILE *fp;
+    size_t len;
+
+    snprintf(path, sizeof(path), "%s%s", dep_dir, name);
+    if((fp = fopen(path, "r")) == NULL)
+        return;
+    len = fread(text, 1, sizeof(text)-1, fp);
+    text[len] = '\0';
+    fclose(fp);
+
+    for(char *ptr = text; (ptr = strstr(ptr, "\\\n")) != NULL; )
+        ptr[0] = ptr[1] = ' ';
+
+    len = strlen(name);
+    int goal = !(len > 4 && !strcmp(&name[len-4], ".o.d"));
+
+    char *save_line;
+    for(char *line = strtok_r(text, "\n", &save_line); line != NULL;
+            line = strtok_r(NULL, "\n", &save_line)) {
+        char *colon = strchr(line, ':');
+        if(colon == NULL)
+            continue;
+        *colon = '\0';
+
+        char *save_word;
+        char *target = strtok_r(line, " \t", &save_word);
+        if(target == NULL)
+            continue;
+
+        for(char *prereq = strtok_r(colon+1, " \t", &save_word); prereq != NULL;
+                prereq = strtok_r(NULL, " \t", &save_word))
+            watch_add_rule(target, prereq, goal);
+    }
+}
+
+static void watch_load_deps(void) {
+
+    DIR *dir;
+    struct dirent *ent;
+
+    num_rules = 0;
+    if((dir = opendir(dep_dir)) == NULL)
+        return;
+
+    while((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if(len > 2 && !strcmp(&ent->d_name[len-2], ".d"))
+            watch_read_deps(ent->d_name);
+    }
+    closedir(dir);
+}
+
+static int watch_is_changed(const char *path) {
+
+    for(int i = 0; i < num_changed; i++)
+        if(!strcmp(changed[i], path))
+            return 1;
+    return 0;
+}
+
+static void watch_add_changed(const char *path) {
+
+    if(num_changed < MAX_RULES && strlen(path) < PATH_MAX && !watch_is_changed(path))
+        strcpy(changed[num_changed++], path);
+}
+
+/*
+ *  Wait for the next change and collect the changed files until the source
+ *  directories have been quiet for the delay.
+ */
+static int watch_wait(int fd) {
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    num_changed = 0;
+    for(;;) {
+        int n = poll(&pfd, 1, num_changed > 0 ? delay : -1);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return num_changed > 0 ? 0 : -1;
+
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if(len <= 0)
+            return -1;
+
+        for(char *ptr = buf; ptr < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+            if(event->len == 0)
+                continue;
+
+            for(int i = 0; i < num_dirs; i++)
+                if(dir_wd[i] == event->wd) {
+                    char path[PATH_MAX];
+                    if(snprintf(path, sizeof(path), "%s/%s", dirs[i], event->name) < PATH_MAX)
+                        watch_add_changed(path);
+                }
+        }
+    }
+}
+
+/*
+ *  Follow the changed files to the test suites that depend on them, then run
+ *  make for those suites. Returns the number of suites.
+ */
+static int watch_rebuild(void) {
+
+    char *argv[MAX_RULES+5];
+    char jobs_arg[32];
+    int argc = 0;
+    int more;
+
+    watch_load_deps();
+
+    for(int i = 0; i < num_changed; i++)
+        for(int k = 0; k < num_rules; k++)
+            if(!strcmp(rules[k].prereq_path, changed[i])) {
+                printf("changed: %s\n", changed[i]);
+                break;
+            }
+
+    do {
+        more = 0;
+        for(int k = 0; k < num_rules; k++)
+            if(watch_is_changed(rules[k].prereq_path) && !watch_is_changed(rules[k].target_path)) {
+                watch_add_changed(rules[k].target_path);
+                more = 1;
+            }
+    } while(more);
+
+    snprintf(jobs_arg, sizeof(jobs_arg), "-j%d", jobs);
+    argv[argc++] = (char*)make_cmd;
+    argv[argc++] = "-k";
+    argv[argc++] = "-Otarget";  // keep the output of each suite together
+    argv[argc++] = jobs_arg;
+    int first = argc;
+
+    for(int k = 0; k < num_rules; k++) {
+        if(!rules[k].goal || !watch_is_changed(rules[k].target_path))
+            continue;
+        int dup = 0;
+        for(int i = first; i < argc; i++)
+            if(!strcmp(argv[i], rules[k].target))
+                dup = 1;
+        if(!dup && argc < MAX_RULES+first)
+            argv[argc++] = rules[k].target;
+    }
+    argv[argc] = NULL;
+
+    if(argc == first)
+        return 0;
+
+    printf("rebuilding:");
+    for(int i = first; i < argc; i++)
+        printf(" %s", argv[i]);
+    printf("\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        execvp(argv[0], argv);
+        printf("cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    if(pid > 0)
+        waitpid(pid, NULL, 0);
+
+    return argc - first;
+}
+
+static void watch_usage(const char *prog) {
+
+    printf("usage: %s [options] dir ...\n", prog);
+    printf("  dir             a directory of source files to watch\n");
+    printf("  --deps=dir      where the compiler writes the dependency files (%s)\n", dep_dir);
+    printf("  --make=cmd      the make program to run (%s)\n", make_cmd);
+    printf("  --jobs=n        the number of suites to build and run at the same time\n");
+    printf("  --delay=ms      wait until there have been no changes for this long (%d)\n", delay);
+    printf("  --help          print this message and exit\n");
+}
+
+int main(int argc, char **argv) {
+
+    int fd;
+
+    jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(jobs < 1)
+        jobs = 1;
+
+    if((fd = inotify_init1(IN_CLOEXEC)) < 0) {
+        printf("cannot watch the source files: %s\n", strerror(errno));
+        return 2;
+    }
+
+    for(int i = 1; i < argc; i++) {
+        if(!strncmp(argv[i], "--deps=", 7))
+            dep_dir = &argv[i][7];
+        else if(!strncmp(argv[i], "--make=", 7))
+            make_cmd = &argv[i][7];
+        else if(!strncmp(argv[i], "--jobs=", 7))
+            jobs = atoi(&argv[i][7]) > 0 ? atoi(&argv[i][7]) : 1;
+        else if(!strncmp(argv[i], "--delay=", 8))
+            delay = atoi(&argv[i][8]);
+        else if(!strcmp(argv[i], "--help")) {
+            watch_usage(argv[0]);
+            return 0;
+        }
+        else if(argv[i][0] == '-') {
+            printf("%s: unknown option \"%s\"\n", argv[0], argv[i]);
+            watch_usage(argv[0]);
+            return 2;
+        }
+        else if(num_dirs >= MAX_DIRS) {
+            printf("too many directories, increase MAX_DIRS (%d)\n", MAX_DIRS);
+            return 2;
+        }
+        else {
+            watch_abspath(argv[i], dirs[num_dirs]);
+            // editors often save by writing a new file and renaming it
+            dir_wd[num_dirs] = inotify_add_watch(fd, dirs[num_dirs],
+                                                 IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+            if(dir_wd[num_dirs] < 0) {
+                printf("cannot watch \"%s\": %s\n", argv[i], strerror(errno));
+                return 2;
+            }
+            num_dirs ++;
+        }
+    }
+
+    if(num_dirs == 0) {
+        watch_usage(argv[0]);
+        return 2;
+    }
+
+    watch_load_deps();
+    if(num_rules == 0)
+        printf("no dependency files in %s yet, build the test suites first\n", dep_dir);
+
+    printf("watching %d directories for changes\n", num_dirs);
+    fflush(stdout);
+
+    while(0 == watch_wait(fd))
+        watch_rebuild();
+
+    close(fd);
+    return 0;
+}